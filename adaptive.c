@@ -0,0 +1,137 @@
+#include "adaptive.h"
+#include "code.h"
+#include "histogram.h"
+#include "huffman.h"
+#include "io.h"
+#include "table.h"
+#include <stdlib.h>
+
+// canonical code evolved from decayed symbol counts, rebuilt at the same
+// points by the encoder and the decoder so that no code is ever stored
+struct Model {
+  uint64_t hist[ALPHABET]; // decayed counts, every symbol at least 1
+  uint64_t seen;           // symbols coded so far
+  uint32_t until;          // symbols left until the next rebuild
+  PackedCode table[ALPHABET];
+  DecodeTable *decoder; // built from table on the first decode after rebuild
+};
+
+// takes in Model
+// rebuilds the code from the counts, at most ADAPT_LIMIT bits long, after
+// halving them once the total passes ADAPT_WINDOW so that old symbols fade,
+// and schedules the next rebuild
+// returns boolean if successful
+static bool model_rebuild(Model *m) {
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    total += m->hist[i];
+  }
+  for (uint32_t i = 0; total > ADAPT_WINDOW && i < ALPHABET; i += 1) {
+    m->hist[i] = (m->hist[i] + 1) / 2;
+  }
+  uint8_t lengths[ALPHABET];
+  if (optimal_lengths(m->hist, lengths) > ADAPT_LIMIT &&
+      !limit_lengths(m->hist, ADAPT_LIMIT, lengths)) {
+    return false;
+  }
+  canonical_codes(lengths, m->table);
+  table_delete(&m->decoder);
+
+  // rebuild often while the model is young, then every ADAPT_INTERVAL
+  m->until = m->seen < ADAPT_MIN ? ADAPT_MIN : m->seen;
+  m->until = m->until < ADAPT_INTERVAL ? m->until : ADAPT_INTERVAL;
+  return true;
+}
+
+// takes in Model, buffer of nbytes just coded
+// counts the symbols and rebuilds the code when it is due
+// returns boolean if successful
+static bool model_update(Model *m, uint8_t *buf, uint32_t nbytes) {
+  histogram_add(buf, nbytes, m->hist);
+  m->seen += nbytes;
+  m->until -= nbytes;
+  return m->until > 0 || model_rebuild(m);
+}
+
+// takes in double pointer to Model
+// destructor for Model
+void model_delete(Model **m) {
+  if (*m) {
+    table_delete(&(*m)->decoder);
+    free(*m);
+    *m = NULL;
+  }
+}
+
+// constructor for Model, starting from equal counts and so 8-bit codes
+// returns Model
+Model *model_create(void) {
+  Model *m = (Model *)calloc(1, sizeof(Model));
+  if (m) {
+    for (uint32_t i = 0; i < ALPHABET; i += 1) {
+      m->hist[i] = 1;
+    }
+    if (!model_rebuild(m)) {
+      model_delete(&m);
+    }
+  }
+  return m;
+}
+
+// takes in number of bytes in a chunk
+// returns the most bytes adaptive_encode() can store for it, with codes of
+// at most ADAPT_LIMIT bits and the padding of the last word
+uint32_t adaptive_bound(uint32_t nbytes) {
+  return ((uint64_t)nbytes * ADAPT_LIMIT + 7) / 8 + 16;
+}
+
+// takes in Model, source buffer of nbytes, destination buffer of at least
+// adaptive_bound(nbytes) bytes
+// compresses src with the evolving code into a bitstream padded to whole
+// bytes, so that each chunk decodes as soon as it arrives
+// returns the number of bytes stored in dst, 0 on failure
+uint32_t adaptive_encode(Model *m, uint8_t *src, uint32_t nbytes,
+                         uint8_t *dst) {
+  BitWriter w;
+  bit_writer_init(&w, -1, dst, adaptive_bound(nbytes));
+  for (uint32_t i = 0; i < nbytes;) {
+    uint32_t n = nbytes - i < m->until ? nbytes - i : m->until;
+    write_symbols(&w, m->table, src + i, n);
+    if (!model_update(m, src + i, n)) {
+      return 0;
+    }
+    i += n;
+  }
+  return bit_writer_flush(&w);
+}
+
+// takes in Model, source buffer of size bytes, destination buffer of nbytes
+// decompresses a chunk stored by adaptive_encode() into dst, evolving the
+// code as the encoder did
+// returns boolean if the whole chunk decoded
+bool adaptive_decode(Model *m, uint8_t *src, uint32_t size, uint8_t *dst,
+                     uint32_t nbytes) {
+  BitReader r;
+  bit_reader_init(&r, -1, src, size);
+  for (uint32_t i = 0; i < nbytes;) {
+    if (!m->decoder) {
+      Code codes[ALPHABET];
+      for (uint32_t s = 0; s < ALPHABET; s += 1) {
+        codes[s] = code_unpack(&m->table[s]);
+      }
+      m->decoder = table_create(codes);
+      if (!m->decoder) {
+        return false;
+      }
+    }
+    uint32_t n = nbytes - i < m->until ? nbytes - i : m->until;
+    if (table_decode(m->decoder, &r, dst + i, n) < n) {
+      return false;
+    }
+    if (!model_update(m, dst + i, n)) {
+      return false;
+    }
+    i += n;
+  }
+  return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "defines.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Model Model;
+
+Model *model_create(void);
+
+void model_delete(Model **m);
+
+uint32_t adaptive_bound(uint32_t nbytes);
+
+uint32_t adaptive_encode(Model *m, uint8_t *src, uint32_t nbytes,
+                         uint8_t *dst);
+
+bool adaptive_decode(Model *m, uint8_t *src, uint32_t size, uint8_t *dst,
+                     uint32_t nbytes);
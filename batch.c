@@ -0,0 +1,228 @@
+#include "batch.h"
+#include "pool.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// a worker of the pool, taking the next file of the list until none are left
+typedef struct {
+  Task task;
+  FileList *list;
+  _Atomic uint32_t *next; // index of the next file to take
+  bool decoding;
+  bool testing; // only read, with outfile -1
+  bool (*run)(int infile, int outfile, void *arg);
+  void *arg;
+  uint64_t in;  // bytes read from the files taken
+  uint64_t out; // bytes written for them
+  uint32_t failed;
+} Worker;
+
+// takes in FileList, path
+// appends a copy of path to the list
+// returns boolean if successful
+bool list_add(FileList *l, const char *path) {
+  if (l->count == l->capacity) {
+    uint32_t capacity = l->capacity ? 2 * l->capacity : 64;
+    char **paths = (char **)realloc(l->paths, capacity * sizeof(char *));
+    if (!paths) {
+      return false;
+    }
+    l->paths = paths;
+    l->capacity = capacity;
+  }
+  l->paths[l->count] = strdup(path);
+  if (!l->paths[l->count]) {
+    return false;
+  }
+  l->count += 1;
+  return true;
+}
+
+// takes in FileList, path of a manifest
+// appends each line of the manifest as a path, skipping empty lines
+// returns boolean if successful
+bool list_manifest(FileList *l, const char *manifest) {
+  FILE *f = fopen(manifest, "r");
+  if (!f) {
+    return false;
+  }
+  char line[PATH_MAX];
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] != '\0') {
+      ok = list_add(l, line);
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+// takes in file name
+// returns boolean if name ends with BATCH_SUFFIX
+static bool compressed_name(const char *name) {
+  size_t n = strlen(name);
+  size_t k = strlen(BATCH_SUFFIX);
+  return n > k && strcmp(name + n - k, BATCH_SUFFIX) == 0;
+}
+
+// takes in FileList, path of a directory, whether to take compressed files
+// appends the regular files under dir, recursively, that end with
+// BATCH_SUFFIX when compressed and that do not otherwise
+// returns boolean if successful
+bool list_walk(FileList *l, const char *dir, bool compressed) {
+  DIR *d = opendir(dir);
+  if (!d) {
+    return false;
+  }
+  bool ok = true;
+  struct dirent *entry;
+  while (ok && (entry = readdir(d))) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+    struct stat stats;
+    if (lstat(path, &stats) == -1) {
+      continue;
+    }
+    if (S_ISDIR(stats.st_mode)) {
+      ok = list_walk(l, path, compressed);
+    } else if (S_ISREG(stats.st_mode) &&
+               compressed_name(entry->d_name) == compressed) {
+      ok = list_add(l, path);
+    }
+  }
+  closedir(d);
+  return ok;
+}
+
+// takes in FileList
+// frees the paths and empties the list
+void list_clear(FileList *l) {
+  for (uint32_t i = 0; i < l->count; i += 1) {
+    free(l->paths[i]);
+  }
+  free(l->paths);
+  l->paths = NULL;
+  l->count = 0;
+  l->capacity = 0;
+}
+
+// takes in Worker, path of a file
+// runs the worker on the file, writing path with BATCH_SUFFIX added or,
+// decoding, removed, and path.out if it has none, or nothing when testing
+static void run_file(Worker *w, const char *path) {
+  char name[PATH_MAX];
+  size_t n = strlen(path);
+  if (!w->decoding) {
+    snprintf(name, sizeof(name), "%s%s", path, BATCH_SUFFIX);
+  } else if (compressed_name(path)) {
+    snprintf(name, sizeof(name), "%.*s", (int)(n - strlen(BATCH_SUFFIX)),
+             path);
+  } else {
+    snprintf(name, sizeof(name), "%s.out", path);
+  }
+  int infile = open(path, O_RDONLY);
+  int outfile = infile == -1 || w->testing
+                    ? -1
+                    : open(name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  bool ok = infile != -1 && (outfile != -1 || w->testing) &&
+            w->run(infile, outfile, w->arg);
+  struct stat stats;
+  if (ok && fstat(infile, &stats) == 0) {
+    w->in += stats.st_size;
+  }
+  if (ok && outfile != -1 && fstat(outfile, &stats) == 0) {
+    w->out += stats.st_size;
+  }
+  if (infile != -1) {
+    close(infile);
+  }
+  if (outfile != -1) {
+    close(outfile);
+  }
+  if (!ok) {
+    fprintf(stderr, "Error: failed to %s %s\n",
+            w->testing ? "verify" : w->decoding ? "decompress" : "compress",
+            path);
+    if (outfile != -1) {
+      unlink(name);
+    }
+    w->failed += 1;
+  }
+}
+
+// takes in Worker
+// takes files from the list until none are left
+static void run_worker(void *arg) {
+  Worker *w = (Worker *)arg;
+  uint32_t i;
+  while ((i = atomic_fetch_add(w->next, 1)) < w->list->count) {
+    run_file(w, w->list->paths[i]);
+  }
+}
+
+// takes in FileList, number of threads, whether decoding, whether only
+// testing the files, function that codes an infile into an outfile, argument
+// of that function
+// codes every file of the list on a pool of threads, each output next to its
+// input, and prints the number of files and the throughput of the batch
+// returns boolean if every file was coded
+bool batch_run(FileList *l, uint32_t threads, bool decoding, bool testing,
+               bool (*run)(int infile, int outfile, void *arg), void *arg) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  _Atomic uint32_t next = 0;
+  Pool *pool = pool_create(threads);
+  Worker *workers = (Worker *)calloc(threads, sizeof(Worker));
+  if (!pool || !workers) {
+    pool_delete(&pool);
+    free(workers);
+    return false;
+  }
+  for (uint32_t i = 0; i < threads; i += 1) {
+    Worker *w = &workers[i];
+    w->task.run = run_worker;
+    w->task.arg = w;
+    w->list = l;
+    w->next = &next;
+    w->decoding = decoding;
+    w->testing = testing;
+    w->run = run;
+    w->arg = arg;
+    pool_submit(pool, &w->task);
+  }
+  uint64_t in = 0;
+  uint64_t out = 0;
+  uint32_t failed = 0;
+  for (uint32_t i = 0; i < threads; i += 1) {
+    pool_wait(pool, &workers[i].task);
+    in += workers[i].in;
+    out += workers[i].out;
+    failed += workers[i].failed;
+  }
+  pool_delete(&pool);
+  free(workers);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  uint64_t raw = decoding && !testing ? out : in;
+  fprintf(stderr,
+          "Batch: %" PRIu32 " files, %" PRIu32 " failed, %" PRIu64
+          " bytes in, %" PRIu64 " bytes out, %.3f s, %.2f MB/s\n",
+          l->count, failed, in, out, seconds,
+          seconds > 0 ? raw / seconds / 1e6 : 0.0);
+  return failed == 0;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "defines.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// paths of the files of a batch
+typedef struct {
+  char **paths;
+  uint32_t count;
+  uint32_t capacity;
+} FileList;
+
+bool list_add(FileList *l, const char *path);
+
+bool list_manifest(FileList *l, const char *manifest);
+
+bool list_walk(FileList *l, const char *dir, bool compressed);
+
+void list_clear(FileList *l);
+
+bool batch_run(FileList *l, uint32_t threads, bool decoding, bool testing,
+               bool (*run)(int infile, int outfile, void *arg), void *arg);
@@ -0,0 +1,548 @@
+#include "adaptive.h"
+#include "compress.h"
+#include "defines.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OPTIONS "hn:s:f:c:o:b:t:"
+#define MAX_CASES 64       // most corpora or sizes
+#define MAX_RUNS 1000      // most runs of a case
+#define DEFAULT_RUNS 5     // runs of a case by default
+#define DEFAULT_SLOWER 5.0 // percent slower than the baseline to fail
+#ifndef BUILD_FLAGS
+#define BUILD_FLAGS "unknown" // compiler and flags, set by the Makefile
+#endif
+
+// generators of the synthetic corpus
+static const char *corpora[] = {"text", "binary", "random", "skewed", "one"};
+#define CORPORA (sizeof(corpora) / sizeof(corpora[0]))
+
+// codecs measured, run in process through the library
+static const char *codecs[] = {"block", "adaptive"};
+#define CODECS (sizeof(codecs) / sizeof(codecs[0]))
+
+// results of one corpus, size and codec
+typedef struct {
+  char corpus[64];
+  uint64_t size;
+  char codec[16];
+  uint32_t runs;
+  double ratio;       // compressed over uncompressed size
+  double encode_mbs;  // median encode throughput
+  double encode_p95;  // throughput of the 95th percentile slowest encode
+  double decode_mbs;  // median decode throughput
+  double decode_p95;  // throughput of the 95th percentile slowest decode
+  uint64_t peak_rss;  // KiB, of the process that ran the case
+  bool ok;            // every run decoded to the input
+} Result;
+
+// prints help page
+static void help(void) {
+  fprintf(stderr, "SYNOPSIS\n");
+  fprintf(stderr, "  Benchmarks Huffman compression and decompression.\n\n");
+  fprintf(stderr, "USAGE\n");
+  fprintf(stderr, "  ./benchmark [-h] [-n runs] [-s sizes] [-f file] "
+                  "[-c codec] [-o format]\n              [-b baseline] "
+                  "[-t percent]\n\n");
+  fprintf(stderr, "OPTIONS\n");
+  fprintf(stderr, "  -h             Program usage and help.\n");
+  fprintf(stderr, "  -n runs        Runs of each case (default %d).\n",
+          DEFAULT_RUNS);
+  fprintf(stderr, "  -s sizes       Comma separated sizes of the generated "
+                  "corpus, K, M or G\n                 suffix "
+                  "(default 1K,64K,1M,16M).\n");
+  fprintf(stderr, "  -f file        Benchmark file instead of the generated "
+                  "corpus, repeatable.\n");
+  fprintf(stderr, "  -c codec       block, adaptive or all (default block).\n");
+  fprintf(stderr, "  -o format      text, csv or json (default text).\n");
+  fprintf(stderr, "  -b baseline    Compare against the csv output of an "
+                  "earlier run.\n");
+  fprintf(stderr, "  -t percent     Slowdown against the baseline that fails "
+                  "(default %.0f).\n",
+          DEFAULT_SLOWER);
+}
+
+// takes in state of the generator
+// xorshift64 generator, so that every run builds the same corpus
+// returns the next pseudo-random number
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+// takes in name of a corpus, buffer of nbytes
+// fills buf with the named synthetic corpus
+static void generate(const char *corpus, uint8_t *buf, uint64_t nbytes) {
+  static const char *words[] = {
+      "the",     "of",    "and",  "to",     "in",     "a",      "is",
+      "that",    "for",   "it",   "as",     "was",    "with",   "be",
+      "by",      "on",    "not",  "he",     "this",   "are",    "or",
+      "his",     "from",  "at",   "which",  "but",    "have",   "an",
+      "had",     "they",  "you",  "were",   "their",  "one",    "all",
+      "we",      "can",   "her",  "has",    "there",  "been",   "if",
+      "more",    "when",  "will", "would",  "who",    "so",     "no",
+      "huffman", "code",  "tree", "symbol", "stream", "block",  "table",
+      "length",  "bits",  "byte", "file",   "data",   "server", "request"};
+  uint32_t nwords = sizeof(words) / sizeof(words[0]);
+  uint64_t state = 0x9E3779B97F4A7C15ull;
+  if (strcmp(corpus, "text") == 0) { // words of falling frequency
+    uint64_t i = 0;
+    uint32_t line = 0;
+    while (i < nbytes) {
+      uint64_t r = next_random(&state);
+      uint32_t w = (r % nwords) * ((r >> 32) % nwords) / nwords;
+      for (const char *c = words[w]; *c && i < nbytes; c += 1) {
+        buf[i++] = line == 0 && c == words[w] ? *c - 32 : *c;
+      }
+      line += 1;
+      if (i < nbytes) {
+        buf[i++] = line == 12 ? '\n' : (r >> 60) == 0 ? ',' : ' ';
+      }
+      line = line == 12 ? 0 : line;
+    }
+  } else if (strcmp(corpus, "binary") == 0) { // 16-byte records
+    uint32_t id = 0;
+    for (uint64_t i = 0; i < nbytes; i += 1) {
+      uint32_t k = i % 16;
+      if (k == 0) {
+        id += 1 + next_random(&state) % 3;
+      }
+      uint64_t r = next_random(&state);
+      buf[i] = k < 4    ? (uint8_t)(id >> (8 * k))
+               : k < 8  ? (uint8_t)(k == 4 ? r % 60 : 0)
+               : k < 12 ? (uint8_t)(r % 7)
+                        : (uint8_t)r;
+    }
+  } else if (strcmp(corpus, "random") == 0) {
+    for (uint64_t i = 0; i < nbytes; i += 1) {
+      buf[i] = next_random(&state);
+    }
+  } else if (strcmp(corpus, "skewed") == 0) { // symbol k with odds 2^-(k+1)
+    for (uint64_t i = 0; i < nbytes; i += 1) {
+      uint64_t r = next_random(&state) | (1ull << 40);
+      buf[i] = 'a' + __builtin_ctzll(r);
+    }
+  } else {
+    memset(buf, 'a', nbytes);
+  }
+}
+
+// takes in path of a file, pointer for its size
+// reads the whole file into memory, growing the buffer as it goes so pipes
+// and process substitutions, which have no size up front, load as well
+// returns buffer holding the file, NULL if it could not be read
+static uint8_t *load(const char *path, uint64_t *nbytes) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return NULL;
+  }
+  uint64_t capacity = 1 << 16;
+  uint64_t size = 0;
+  uint8_t *buf = (uint8_t *)malloc(capacity);
+  while (buf) {
+    size += fread(buf + size, 1, capacity - size, f);
+    if (size < capacity) {
+      break;
+    }
+    capacity *= 2;
+    uint8_t *grown = (uint8_t *)realloc(buf, capacity);
+    if (!grown) {
+      free(buf);
+    }
+    buf = grown;
+  }
+  if (buf && ferror(f)) {
+    free(buf);
+    buf = NULL;
+  }
+  fclose(f);
+  *nbytes = size;
+  return buf;
+}
+
+// takes in size argument, with an optional K, M or G suffix
+// returns size in bytes, 0 if invalid
+static uint64_t parse_size(const char *arg, char **end) {
+  uint64_t size = strtoull(arg, end, 10);
+  switch (**end) {
+  case 'K':
+  case 'k':
+    size <<= 10;
+    *end += 1;
+    break;
+  case 'M':
+  case 'm':
+    size <<= 20;
+    *end += 1;
+    break;
+  case 'G':
+  case 'g':
+    size <<= 30;
+    *end += 1;
+    break;
+  }
+  return size;
+}
+
+// takes in time to compare, time to compare
+// orders times for qsort
+static int compare_times(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// returns the current time in seconds
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// takes in codec, source buffer of nbytes, destination buffer of capacity
+// bytes
+// compresses src with the codec, the adaptive one in ADAPT_CHUNK chunks of a
+// 4-byte size and the chunk
+// returns the number of bytes stored in dst, -1 on failure
+static int64_t run_encode(const char *codec, uint8_t *src, uint64_t nbytes,
+                          uint8_t *dst, uint64_t capacity) {
+  if (strcmp(codec, "block") == 0) {
+    return compress(src, nbytes, dst, capacity);
+  }
+  Model *m = model_create();
+  uint64_t size = 0;
+  for (uint64_t i = 0; m && i < nbytes; i += ADAPT_CHUNK) {
+    uint32_t n = nbytes - i < ADAPT_CHUNK ? nbytes - i : ADAPT_CHUNK;
+    uint32_t chunk = adaptive_encode(m, src + i, n, dst + size + 4);
+    memcpy(dst + size, &chunk, 4);
+    size += 4 + chunk;
+  }
+  bool ok = m != NULL;
+  model_delete(&m);
+  return ok ? (int64_t)size : -1;
+}
+
+// takes in codec, source buffer of size bytes, destination buffer of nbytes
+// decompresses src as stored by run_encode()
+// returns boolean if successful
+static bool run_decode(const char *codec, uint8_t *src, uint64_t size,
+                       uint8_t *dst, uint64_t nbytes) {
+  if (strcmp(codec, "block") == 0) {
+    return decompress(src, size, dst, nbytes) == (int64_t)nbytes;
+  }
+  Model *m = model_create();
+  uint64_t offset = 0;
+  bool ok = m != NULL;
+  for (uint64_t i = 0; ok && i < nbytes; i += ADAPT_CHUNK) {
+    uint32_t n = nbytes - i < ADAPT_CHUNK ? nbytes - i : ADAPT_CHUNK;
+    uint32_t chunk = 0;
+    memcpy(&chunk, src + offset, 4);
+    ok = adaptive_decode(m, src + offset + 4, chunk, dst + i, n);
+    offset += 4 + chunk;
+  }
+  model_delete(&m);
+  return ok;
+}
+
+// takes in Result naming the case, input buffer of r->size bytes
+// runs the case r->runs times, timing each encode and decode and checking
+// the round trip, and fills in the rest of r
+static void run_case(Result *r, uint8_t *in) {
+  uint64_t nbytes = r->size;
+  uint64_t capacity = compress_bound(nbytes);
+  uint64_t chunks = (nbytes + ADAPT_CHUNK - 1) / ADAPT_CHUNK;
+  uint64_t adaptive = chunks * (4 + adaptive_bound(ADAPT_CHUNK));
+  capacity = adaptive > capacity ? adaptive : capacity;
+  uint8_t *out = (uint8_t *)malloc(capacity);
+  uint8_t *back = (uint8_t *)malloc(nbytes > 0 ? nbytes : 1);
+  double encode[MAX_RUNS];
+  double decode[MAX_RUNS];
+  int64_t size = -1;
+  r->ok = out && back;
+  for (uint32_t i = 0; r->ok && i < r->runs; i += 1) {
+    double start = now();
+    size = run_encode(r->codec, in, nbytes, out, capacity);
+    double middle = now();
+    r->ok = size >= 0 && run_decode(r->codec, out, size, back, nbytes);
+    encode[i] = middle - start;
+    decode[i] = now() - middle;
+    r->ok = r->ok && memcmp(in, back, nbytes) == 0;
+  }
+  free(out);
+  free(back);
+  if (!r->ok) {
+    return;
+  }
+  qsort(encode, r->runs, sizeof(double), compare_times);
+  qsort(decode, r->runs, sizeof(double), compare_times);
+  uint32_t median = r->runs / 2;
+  uint32_t p95 = (r->runs * 95 + 99) / 100 - 1; // nearest rank
+  double mb = nbytes / 1e6;
+  r->ratio = nbytes ? (double)size / nbytes : 0;
+  r->encode_mbs = encode[median] > 0 ? mb / encode[median] : 0;
+  r->encode_p95 = encode[p95] > 0 ? mb / encode[p95] : 0;
+  r->decode_mbs = decode[median] > 0 ? mb / decode[median] : 0;
+  r->decode_p95 = decode[p95] > 0 ? mb / decode[p95] : 0;
+}
+
+// takes in Result naming the case, file to load or NULL to generate the
+// corpus
+// runs the case in a child process, so that its peak RSS is its own
+// returns boolean if the case ran and round tripped
+static bool measure(Result *r, const char *file) {
+  int fds[2];
+  if (pipe(fds) == -1) {
+    return false;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    uint8_t *in = NULL;
+    if (file) {
+      in = load(file, &r->size);
+    } else {
+      in = (uint8_t *)malloc(r->size > 0 ? r->size : 1);
+      if (in) {
+        generate(r->corpus, in, r->size);
+      }
+    }
+    r->ok = in != NULL;
+    if (in) {
+      run_case(r, in);
+    }
+    free(in);
+    ssize_t written = write(fds[1], r, sizeof(*r));
+    _exit(written == sizeof(*r) ? 0 : 1);
+  }
+  close(fds[1]);
+  bool ok = pid > 0 && read(fds[0], r, sizeof(*r)) == sizeof(*r);
+  close(fds[0]);
+  struct rusage usage;
+  int status = 0;
+  if (pid > 0 && wait4(pid, &status, 0, &usage) == pid) {
+    r->peak_rss = usage.ru_maxrss;
+  }
+  return ok && r->ok;
+}
+
+// takes in Result, output format, whether it is the first result
+// prints r as a row of text, csv or a json object
+static void print_result(Result *r, const char *format, bool first) {
+  if (strcmp(format, "csv") == 0) {
+    printf("%s,%" PRIu64 ",%s,%" PRIu32 ",%.6f,%.2f,%.2f,%.2f,%.2f,%" PRIu64
+           ",%s\n",
+           r->corpus, r->size, r->codec, r->runs, r->ratio, r->encode_mbs,
+           r->encode_p95, r->decode_mbs, r->decode_p95, r->peak_rss,
+           BUILD_FLAGS);
+  } else if (strcmp(format, "json") == 0) {
+    printf("%s  {\"corpus\": \"%s\", \"size\": %" PRIu64 ", \"codec\": \"%s\", "
+           "\"runs\": %" PRIu32 ", \"ratio\": %.6f, \"encode_mbs\": %.2f, "
+           "\"encode_p95_mbs\": %.2f, \"decode_mbs\": %.2f, "
+           "\"decode_p95_mbs\": %.2f, \"peak_rss_kib\": %" PRIu64 ", "
+           "\"build\": \"%s\"}",
+           first ? "" : ",\n", r->corpus, r->size, r->codec, r->runs, r->ratio,
+           r->encode_mbs, r->encode_p95, r->decode_mbs, r->decode_p95,
+           r->peak_rss, BUILD_FLAGS);
+  } else {
+    printf("%-12s %12" PRIu64 " %-9s %7.4f %10.2f %10.2f %10.2f %10.2f "
+           "%10" PRIu64 "\n",
+           r->corpus, r->size, r->codec, r->ratio, r->encode_mbs,
+           r->encode_p95, r->decode_mbs, r->decode_p95, r->peak_rss);
+  }
+}
+
+// takes in output format
+// prints what comes before the results
+static void print_header(const char *format) {
+  if (strcmp(format, "csv") == 0) {
+    printf("corpus,size,codec,runs,ratio,encode_mbs,encode_p95_mbs,"
+           "decode_mbs,decode_p95_mbs,peak_rss_kib,build\n");
+  } else if (strcmp(format, "json") == 0) {
+    printf("[\n");
+  } else {
+    printf("build: %s\n", BUILD_FLAGS);
+    printf("%-12s %12s %-9s %7s %10s %10s %10s %10s %10s\n", "corpus", "size",
+           "codec", "ratio", "enc MB/s", "enc p95", "dec MB/s", "dec p95",
+           "RSS KiB");
+  }
+}
+
+// takes in Result of this run, path of a baseline csv, slowdown in percent
+// that fails
+// prints how r compares with the same case in the baseline
+// returns boolean if r is no slower than the baseline allows and no larger,
+// false if the baseline was measured with another build
+static bool compare(Result *r, const char *baseline, double slower) {
+  FILE *f = fopen(baseline, "r");
+  if (!f) {
+    return false;
+  }
+  char line[1024];
+  char build[512];
+  bool found = false;
+  Result b;
+  while (!found && fgets(line, sizeof(line), f)) {
+    char corpus[64];
+    char codec[16];
+    if (sscanf(line,
+               "%63[^,],%" SCNu64 ",%15[^,],%" SCNu32 ",%lf,%lf,%lf,%lf,%lf,"
+               "%" SCNu64 ",%511[^\n]",
+               corpus, &b.size, codec, &b.runs, &b.ratio, &b.encode_mbs,
+               &b.encode_p95, &b.decode_mbs, &b.decode_p95, &b.peak_rss,
+               build) == 11 &&
+        strcmp(corpus, r->corpus) == 0 && strcmp(codec, r->codec) == 0 &&
+        b.size == r->size) {
+      found = true;
+    }
+  }
+  fclose(f);
+  if (found && strcmp(build, BUILD_FLAGS) != 0) {
+    fprintf(stderr,
+            "%s %" PRIu64 " %s: baseline built with \"%s\", not \"%s\"\n",
+            r->corpus, r->size, r->codec, build, BUILD_FLAGS);
+    return false;
+  }
+  if (!found) {
+    fprintf(stderr, "%s %" PRIu64 " %s: not in baseline\n", r->corpus,
+            r->size, r->codec);
+    return true;
+  }
+  double encode = b.encode_mbs > 0 ? 100 * (r->encode_mbs / b.encode_mbs - 1)
+                                   : 0;
+  double decode = b.decode_mbs > 0 ? 100 * (r->decode_mbs / b.decode_mbs - 1)
+                                   : 0;
+  bool ok = encode >= -slower && decode >= -slower &&
+            r->ratio <= b.ratio + 1e-6;
+  fprintf(stderr,
+          "%s %" PRIu64 " %s: encode %+.1f%%, decode %+.1f%%, ratio %.6f "
+          "was %.6f%s\n",
+          r->corpus, r->size, r->codec, encode, decode, r->ratio, b.ratio,
+          ok ? "" : "  REGRESSION");
+  return ok;
+}
+
+// driver code of program
+int main(int argc, char **argv) {
+  uint32_t runs = DEFAULT_RUNS;
+  uint64_t sizes[MAX_CASES] = {1 << 10, 64 << 10, 1 << 20, 16 << 20};
+  uint32_t nsizes = 4;
+  const char *files[MAX_CASES];
+  uint32_t nfiles = 0;
+  const char *codec = "block";
+  const char *format = "text";
+  const char *baseline = NULL;
+  double slower = DEFAULT_SLOWER;
+  int opt = 0;
+  while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+    switch (opt) {
+    case 'h':
+      help();
+      return 0;
+    case 'n':
+      runs = strtoul(optarg, NULL, 10);
+      if (runs == 0 || runs > MAX_RUNS) {
+        fprintf(stderr, "Error: runs must be 1 to %d\n", MAX_RUNS);
+        return 1;
+      }
+      break;
+    case 's': {
+      char *end = optarg;
+      nsizes = 0;
+      while (*end != '\0' && nsizes < MAX_CASES) {
+        sizes[nsizes] = parse_size(end, &end);
+        nsizes += 1;
+        if (*end != ',' && *end != '\0') {
+          fprintf(stderr, "Error: invalid size list\n");
+          return 1;
+        }
+        end += *end == ',';
+      }
+      break;
+    }
+    case 'f':
+      if (nfiles < MAX_CASES) {
+        files[nfiles] = optarg;
+        nfiles += 1;
+      }
+      break;
+    case 'c':
+      codec = optarg;
+      if (strcmp(codec, "all") != 0 && strcmp(codec, "block") != 0 &&
+          strcmp(codec, "adaptive") != 0) {
+        fprintf(stderr, "Error: codec must be block, adaptive or all\n");
+        return 1;
+      }
+      break;
+    case 'o':
+      format = optarg;
+      if (strcmp(format, "text") != 0 && strcmp(format, "csv") != 0 &&
+          strcmp(format, "json") != 0) {
+        fprintf(stderr, "Error: format must be text, csv or json\n");
+        return 1;
+      }
+      break;
+    case 'b':
+      baseline = optarg;
+      break;
+    case 't':
+      slower = strtod(optarg, NULL);
+      break;
+    default:
+      help();
+      return 1;
+    }
+  }
+
+  // every generated corpus at every size, or every file, with each codec
+  bool ok = true;
+  bool first = true;
+  print_header(format);
+  uint32_t ncases = nfiles > 0 ? nfiles : CORPORA * nsizes;
+  for (uint32_t i = 0; i < ncases; i += 1) {
+    for (uint32_t c = 0; c < CODECS; c += 1) {
+      if (strcmp(codec, "all") != 0 && strcmp(codec, codecs[c]) != 0) {
+        continue;
+      }
+      Result r;
+      memset(&r, 0, sizeof(r));
+      r.runs = runs;
+      snprintf(r.codec, sizeof(r.codec), "%s", codecs[c]);
+      const char *file = nfiles > 0 ? files[i] : NULL;
+      if (file) {
+        const char *name = strrchr(file, '/');
+        snprintf(r.corpus, sizeof(r.corpus), "%s", name ? name + 1 : file);
+      } else {
+        snprintf(r.corpus, sizeof(r.corpus), "%s", corpora[i / nsizes]);
+        r.size = sizes[i % nsizes];
+      }
+      if (!measure(&r, file)) {
+        fprintf(stderr, "Error: %s %" PRIu64 " %s failed\n", r.corpus, r.size,
+                r.codec);
+        ok = false;
+        continue;
+      }
+      print_result(&r, format, first);
+      fflush(stdout);
+      first = false;
+      if (baseline) {
+        ok = compare(&r, baseline, slower) && ok;
+      }
+    }
+  }
+  if (strcmp(format, "json") == 0) {
+    printf("\n]\n");
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,376 @@
+#include "block.h"
+#include "code.h"
+#include "crc.h"
+#include "histogram.h"
+#include "huffman.h"
+#include "io.h"
+#include "table.h"
+#include <string.h>
+
+// takes in number of bytes in a block
+// returns the most bytes encode_block() can store for it: the mode byte, the
+// code lengths, the stream sizes and bitstreams no longer than the block,
+// since no optimal code beats 8 bits, plus the padding of each stream; a
+// block coded by context is only kept when smaller than that; and room for
+// the checksum of FLAG_CHECKSUM after it
+uint32_t block_bound(uint32_t nbytes) {
+  return 1 + MAX_LENGTHS_SIZE + 1 + 4 * MAX_STREAMS + nbytes +
+         16 * MAX_STREAMS + 4;
+}
+
+// takes in histogram, maximum code length, array of code lengths
+// computes the code lengths of a block, at most limit bits long when limit is
+// set and never longer than MAX_PACKED_BITS
+// returns boolean if successful
+static bool block_lengths(uint64_t hist[static ALPHABET], uint32_t limit,
+                          uint8_t lengths[static ALPHABET]) {
+  uint32_t longest = optimal_lengths(hist, lengths);
+  if (limit == 0 || limit > MAX_PACKED_BITS) {
+    limit = MAX_PACKED_BITS;
+  }
+  if (longest > limit) {
+    return limit_lengths(hist, limit, lengths);
+  }
+  return true;
+}
+
+// order-1 statistics of a block: the symbols that follow each byte
+typedef struct {
+  uint32_t counts[ALPHABET][ALPHABET];   // symbol counts after each byte
+  uint8_t successors[ALPHABET][ALPHABET]; // symbols seen after each byte
+  uint16_t present[ALPHABET];            // number of successors
+  uint64_t totals[ALPHABET];             // symbols after each byte
+} Successors;
+
+// code tables of a block coded by context
+typedef struct {
+  uint32_t groups;                           // code tables
+  uint8_t map[ALPHABET];                     // group of each previous byte
+  uint8_t lengths[CONTEXT_GROUPS][ALPHABET]; // code lengths of each group
+  uint32_t size;                             // most bytes of the whole block
+} Contexts;
+
+// takes in Successors, previous byte, code lengths
+// returns the bits to code the successors of prev with lengths
+static uint64_t context_cost(Successors *s, uint32_t prev,
+                             uint8_t lengths[static ALPHABET]) {
+  uint64_t bits = 0;
+  for (uint32_t i = 0; i < s->present[prev]; i += 1) {
+    uint8_t symbol = s->successors[prev][i];
+    bits += (uint64_t)s->counts[prev][symbol] * lengths[symbol];
+  }
+  return bits;
+}
+
+// takes in Successors, most groups, map for the group of each previous byte
+// clusters the previous bytes into at most wanted groups: the most frequent
+// ones seed the groups, and each round gives every group a code for the
+// successors of its bytes, with every symbol possible, and moves each byte
+// to the group whose code takes the fewest bits for its successors
+// returns the number of groups
+static uint32_t cluster_contexts(Successors *s, uint32_t wanted,
+                                 uint8_t map[static ALPHABET]) {
+  bool seed[ALPHABET] = {false};
+  uint32_t groups = 0;
+  memset(map, 0, ALPHABET);
+  for (; groups < wanted; groups += 1) {
+    uint32_t best = ALPHABET;
+    for (uint32_t c = 0; c < ALPHABET; c += 1) {
+      if (!seed[c] && s->totals[c] > 0 &&
+          (best == ALPHABET || s->totals[c] > s->totals[best])) {
+        best = c;
+      }
+    }
+    if (best == ALPHABET) {
+      break;
+    }
+    seed[best] = true;
+    map[best] = groups;
+  }
+  for (uint32_t round = 0; groups > 1 && round < CONTEXT_ROUNDS; round += 1) {
+    uint64_t hist[CONTEXT_GROUPS][ALPHABET] = {{0}};
+    uint8_t lengths[CONTEXT_GROUPS][ALPHABET];
+    for (uint32_t c = 0; c < ALPHABET; c += 1) {
+      if (seed[c] || (round > 0 && s->totals[c] > 0)) {
+        for (uint32_t i = 0; i < ALPHABET; i += 1) {
+          hist[map[c]][i] += s->counts[c][i];
+        }
+      }
+    }
+    for (uint32_t g = 0; g < groups; g += 1) {
+      for (uint32_t i = 0; i < ALPHABET; i += 1) {
+        hist[g][i] = hist[g][i] * ALPHABET + 1;
+      }
+      optimal_lengths(hist[g], lengths[g]);
+    }
+    for (uint32_t c = 0; c < ALPHABET; c += 1) {
+      uint64_t least = UINT64_MAX;
+      for (uint32_t g = 0; s->totals[c] > 0 && g < groups; g += 1) {
+        uint64_t bits = context_cost(s, c, lengths[g]);
+        if (bits < least) {
+          least = bits;
+          map[c] = g;
+        }
+      }
+    }
+  }
+
+  // number the groups still in use from 0
+  uint8_t renumber[CONTEXT_GROUPS];
+  bool used[CONTEXT_GROUPS] = {false};
+  for (uint32_t c = 0; c < ALPHABET; c += 1) {
+    used[map[c]] = used[map[c]] || s->totals[c] > 0;
+  }
+  uint32_t n = 0;
+  for (uint32_t g = 0; g < groups; g += 1) {
+    renumber[g] = n;
+    n += used[g];
+  }
+  for (uint32_t c = 0; c < ALPHABET; c += 1) {
+    map[c] = s->totals[c] > 0 ? renumber[map[c]] : 0;
+  }
+  return n;
+}
+
+// takes in source buffer of nbytes, number of bitstreams, maximum code length
+// or 0, size of the block coded without context, Contexts
+// chooses code tables selected by the previous byte in the segment of each
+// symbol, for the previous bytes clustered into CONTEXT_GROUPS groups or a
+// quarter as many
+// returns boolean if the block codes in fewer than budget bytes that way
+static bool context_code(uint8_t *src, uint32_t nbytes, uint32_t streams,
+                         uint32_t limit, uint32_t budget, Contexts *best) {
+  Successors successors; // on the stack, so that blocks code allocation free
+  Successors *s = &successors;
+  memset(s, 0, sizeof(*s));
+  uint32_t segment = (nbytes + streams - 1) / streams;
+  for (uint32_t start = 0; start < nbytes; start += segment) {
+    uint32_t end = start + segment < nbytes ? start + segment : nbytes;
+    uint8_t prev = 0; // each segment starts afresh
+    for (uint32_t i = start; i < end; i += 1) {
+      s->counts[prev][src[i]] += 1;
+      prev = src[i];
+    }
+  }
+  for (uint32_t c = 0; c < ALPHABET; c += 1) {
+    for (uint32_t i = 0; i < ALPHABET; i += 1) {
+      if (s->counts[c][i] > 0) {
+        s->successors[c][s->present[c]] = i;
+        s->present[c] += 1;
+        s->totals[c] += s->counts[c][i];
+      }
+    }
+  }
+  bool found = false;
+  best->size = budget;
+  for (uint32_t wanted = CONTEXT_GROUPS; wanted > 1; wanted /= 4) {
+    Contexts c;
+    c.groups = cluster_contexts(s, wanted, c.map);
+    if (c.groups < 2) {
+      break;
+    }
+    uint64_t hist[CONTEXT_GROUPS][ALPHABET] = {{0}};
+    for (uint32_t prev = 0; prev < ALPHABET; prev += 1) {
+      for (uint32_t i = 0; i < ALPHABET; i += 1) {
+        hist[c.map[prev]][i] += s->counts[prev][i];
+      }
+    }
+    uint64_t bits = 0;
+    uint64_t size = 1 + ALPHABET / 2 + (streams > 1 ? 1 + 4 * (streams - 1)
+                                                    : 0);
+    bool ok = true;
+    for (uint32_t g = 0; ok && g < c.groups; g += 1) {
+      uint8_t packed[MAX_LENGTHS_SIZE];
+      ok = block_lengths(hist[g], limit, c.lengths[g]);
+      for (uint32_t i = 0; i < ALPHABET; i += 1) {
+        bits += hist[g][i] * c.lengths[g][i];
+      }
+      size += pack_lengths(c.lengths[g], packed);
+    }
+    size += (bits + 7) / 8 + streams; // and the padding of each stream
+    if (ok && size < best->size) {
+      c.size = size;
+      *best = c;
+      found = true;
+    }
+  }
+  return found;
+}
+
+// takes in source buffer of nbytes, destination buffer of at least
+// block_bound(nbytes) bytes, maximum code length or 0 for none, number of
+// bitstreams, whether to try coding by context, pointer for the length of
+// the bitstreams in bits
+// compresses src with its own canonical code: the packed code lengths
+// followed by the bitstream, or with several streams by their count, the
+// sizes of all but the last one, and then the streams of consecutive
+// segments of src; with context, a mode byte comes first, 0 for a single
+// code, or the number of groups followed by the group of each previous byte
+// packed two to a byte and the code lengths of each group, when that is
+// smaller
+// returns the number of bytes stored in dst, 0 on failure
+uint32_t encode_block(uint8_t *src, uint32_t nbytes, uint8_t *dst,
+                      uint32_t limit, uint32_t streams, bool context,
+                      uint64_t *bits) {
+  uint64_t hist[ALPHABET] = {0};
+  histogram_add(src, nbytes, hist);
+  uint8_t lengths[ALPHABET];
+  if (!block_lengths(hist, limit, lengths)) {
+    return 0;
+  }
+  uint32_t size = 0;
+  Contexts c;
+  c.groups = 0;
+  if (context) {
+    uint64_t coded = 0;
+    for (uint32_t i = 0; i < ALPHABET; i += 1) {
+      coded += hist[i] * lengths[i];
+    }
+    uint32_t budget = 1 + pack_lengths(lengths, dst) + (coded + 7) / 8 +
+                      (streams > 1 ? 1 + 4 * (streams - 1) : 0);
+    if (!context_code(src, nbytes, streams, limit, budget, &c)) {
+      c.groups = 0;
+    }
+    dst[0] = c.groups;
+    size = 1;
+  }
+  PackedCode table[ALPHABET];
+  PackedCode tables[CONTEXT_GROUPS][ALPHABET];
+  if (c.groups > 0) {
+    memset(dst + size, 0, ALPHABET / 2);
+    for (uint32_t i = 0; i < ALPHABET; i += 1) {
+      dst[size + i / 2] |= c.map[i] << (4 * (i % 2));
+    }
+    size += ALPHABET / 2;
+    for (uint32_t g = 0; g < c.groups; g += 1) {
+      canonical_codes(c.lengths[g], tables[g]);
+      size += pack_lengths(c.lengths[g], dst + size);
+    }
+  } else {
+    canonical_codes(lengths, table);
+    size += pack_lengths(lengths, dst + size);
+  }
+  uint8_t *sizes = dst + size + 1;
+  if (streams > 1) {
+    dst[size] = streams;
+    size += 1 + 4 * (streams - 1);
+  }
+  uint32_t segment = (nbytes + streams - 1) / streams;
+  *bits = 0;
+  for (uint32_t k = 0; k < streams; k += 1) {
+    uint32_t start = k * segment < nbytes ? k * segment : nbytes;
+    uint32_t end = start + segment < nbytes ? start + segment : nbytes;
+    BitWriter w;
+    bit_writer_init(&w, -1, dst + size, block_bound(nbytes) - size);
+    if (c.groups > 0) {
+      write_context_symbols(&w, tables, c.map, src + start, end - start);
+    } else {
+      write_symbols(&w, table, src + start, end - start);
+    }
+    *bits += (uint64_t)w.index * 8 + w.count;
+    uint32_t stream_size = bit_writer_flush(&w);
+    if (k < streams - 1) {
+      memcpy(sizes + 4 * k, &stream_size, 4);
+    }
+    size += stream_size;
+  }
+  return size;
+}
+
+// takes in buffer of size bytes, DecodeTable
+// fills t from code lengths stored by pack_lengths()
+// returns the number of bytes used, 0 unless they are valid
+static uint32_t load_table(uint8_t *buf, uint32_t size, DecodeTable *t) {
+  uint8_t lengths[ALPHABET];
+  uint32_t used = unpack_lengths(buf, size, lengths);
+  if (used == 0) {
+    return 0;
+  }
+  PackedCode packed[ALPHABET];
+  Code codes[ALPHABET];
+  canonical_codes(lengths, packed);
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    codes[i] = code_unpack(&packed[i]);
+  }
+  table_init(t, codes);
+  return used;
+}
+
+// takes in source buffer of size bytes, destination buffer of nbytes, flags of
+// the file header
+// decompresses a block stored by encode_block() into dst, checking it against
+// the CRC32C after it with FLAG_CHECKSUM
+// returns boolean if the whole block decoded
+bool decode_block(uint8_t *src, uint32_t size, uint8_t *dst, uint32_t nbytes,
+                  uint8_t flags) {
+  uint32_t used = 0;
+  uint32_t groups = 0;
+  uint8_t map[ALPHABET];
+  uint32_t checksum = 0;
+  if (flags & FLAG_CHECKSUM) {
+    if (size < sizeof(checksum)) {
+      return false;
+    }
+    size -= sizeof(checksum);
+    memcpy(&checksum, src + size, sizeof(checksum));
+  }
+  if (flags & FLAG_CONTEXT) {
+    if (size < 1 || src[0] > CONTEXT_GROUPS ||
+        (src[0] > 0 && size < 1 + ALPHABET / 2)) {
+      return false;
+    }
+    groups = src[0];
+    used = 1;
+  }
+  DecodeTable tables[CONTEXT_GROUPS]; // one without context
+  if (groups > 0) {
+    for (uint32_t i = 0; i < ALPHABET; i += 1) {
+      map[i] = (src[used + i / 2] >> (4 * (i % 2))) & 0xF;
+      if (map[i] >= groups) {
+        return false;
+      }
+    }
+    used += ALPHABET / 2;
+    for (uint32_t g = 0; g < groups; g += 1) {
+      uint32_t n = load_table(src + used, size - used, &tables[g]);
+      if (n == 0) {
+        return false;
+      }
+      used += n;
+    }
+  } else {
+    uint32_t n = load_table(src + used, size - used, &tables[0]);
+    if (n == 0) {
+      return false;
+    }
+    used += n;
+  }
+  uint32_t streams = 1;
+  bool ok = true;
+  if (flags & FLAG_STREAMS) {
+    streams = used < size ? src[used] : 0;
+    ok = streams > 0 && streams <= MAX_STREAMS &&
+         used + 1 + 4 * (streams - 1) <= size;
+    used += ok ? 1 + 4 * (streams - 1) : 0;
+  }
+  BitReader r[MAX_STREAMS];
+  uint32_t offset = used;
+  for (uint32_t k = 0; ok && k < streams; k += 1) {
+    uint32_t stream_size = size - offset;
+    if (k < streams - 1) {
+      memcpy(&stream_size, src + used - 4 * (streams - 1 - k), 4);
+    }
+    ok = stream_size <= size - offset;
+    bit_reader_init(&r[k], -1, src + offset, stream_size);
+    offset += stream_size;
+  }
+  if (ok && groups > 0) {
+    ok = table_decode_context(tables, map, r, streams, dst, nbytes);
+  } else if (ok) {
+    ok = table_decode_streams(&tables[0], r, streams, dst, nbytes);
+  }
+  if (ok && (flags & FLAG_CHECKSUM)) { // while dst is still in cache
+    ok = crc32c(0, dst, nbytes) == checksum;
+  }
+  return ok;
+}
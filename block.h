@@ -0,0 +1,14 @@
+#pragma once
+
+#include "defines.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+uint32_t block_bound(uint32_t nbytes);
+
+uint32_t encode_block(uint8_t *src, uint32_t nbytes, uint8_t *dst,
+                      uint32_t limit, uint32_t streams, bool context,
+                      uint64_t *bits);
+
+bool decode_block(uint8_t *src, uint32_t size, uint8_t *dst, uint32_t nbytes,
+                  uint8_t flags);
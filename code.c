@@ -33,7 +33,7 @@ bool code_full(Code *c) { return c->top == MAX_CODE_SIZE * 8; }
 // set bit i in code c to 1
 // return boolean if successful
 bool code_set_bit(Code *c, uint32_t i) {
-  if (i > MAX_CODE_SIZE || i < 0) {
+  if (i >= MAX_CODE_SIZE * 8) {
     return false;
   }
   c->bits[i / 8] |= (1 << (i % 8));
@@ -44,7 +44,7 @@ bool code_set_bit(Code *c, uint32_t i) {
 // clear bit i in code c to 0
 // return boolean if sucessful
 bool code_clr_bit(Code *c, uint32_t i) {
-  if (i > MAX_CODE_SIZE || i < 0) {
+  if (i >= MAX_CODE_SIZE * 8) {
     return false;
   }
   c->bits[i / 8] &= ~(1 << (i % 8));
@@ -55,7 +55,7 @@ bool code_clr_bit(Code *c, uint32_t i) {
 // get bit i in code c
 // return boolean if 0 or 1 or if out of bounds
 bool code_get_bit(Code *c, uint32_t i) {
-  if (i > MAX_CODE_SIZE || i < 0) {
+  if (i >= MAX_CODE_SIZE * 8) {
     return false;
   }
   return (c->bits[i / 8] >> i % 8) & 0x1;
@@ -93,6 +93,28 @@ bool code_pop_bit(Code *c, uint8_t *bit) {
   return false;
 }
 
+// takes in code c
+// packs the first MAX_PACKED_BITS bits of c into an integer
+// returns PackedCode holding those bits and the full length of c
+PackedCode code_pack(Code *c) {
+  PackedCode p = {0, code_size(c)};
+  for (uint32_t i = 0; i < code_size(c) && i < MAX_PACKED_BITS; i += 1) {
+    p.bits |= (uint64_t)code_get_bit(c, i) << i;
+  }
+  return p;
+}
+
+// takes in PackedCode p of at most MAX_PACKED_BITS bits
+// unpacks p into a Code
+// returns Code
+Code code_unpack(PackedCode *p) {
+  Code c = code_init();
+  for (uint32_t i = 0; i < p->length; i += 1) {
+    code_push_bit(&c, (p->bits >> i) & 1);
+  }
+  return c;
+}
+
 // helper function for code_print()
 // print bits in byte
 void print_bits_in_byte(uint8_t byte) {
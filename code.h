@@ -9,6 +9,11 @@ typedef struct {
   uint8_t bits[MAX_CODE_SIZE];
 } Code;
 
+typedef struct {
+  uint64_t bits; // code bits, first bit in the lowest position
+  uint32_t length;
+} PackedCode;
+
 Code code_init(void);
 
 uint32_t code_size(Code *c);
@@ -27,4 +32,8 @@ bool code_push_bit(Code *c, uint8_t bit);
 
 bool code_pop_bit(Code *c, uint8_t *bit);
 
+PackedCode code_pack(Code *c);
+
+Code code_unpack(PackedCode *p);
+
 void code_print(Code *c);
@@ -0,0 +1,156 @@
+#include "compress.h"
+#include "block.h"
+#include "header.h"
+#include <stdlib.h>
+#include <string.h>
+
+// takes in number of bytes
+// returns the most bytes compress() can store for nbytes: the header and,
+// for each block, its header and block_bound() bytes
+uint64_t compress_bound(uint64_t nbytes) {
+  uint64_t blocks = (nbytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  return sizeof(Header) + blocks * (sizeof(BlockHeader) + block_bound(0)) +
+         nbytes;
+}
+
+// takes in source buffer of nbytes, destination buffer of capacity bytes
+// compresses src into dst in the block format read by decode, in blocks of
+// BLOCK_SIZE, without allocating
+// returns the number of bytes stored in dst, -1 if capacity is less than
+// compress_bound(nbytes) or a block failed
+int64_t compress(uint8_t *src, uint64_t nbytes, uint8_t *dst,
+                 uint64_t capacity) {
+  if (capacity < compress_bound(nbytes)) {
+    return -1;
+  }
+  Header header;
+  header.magic = MAGIC_VERSIONED;
+  header.permissions = 0600;
+  header.version = VERSION_BLOCKS;
+  header.flags = 0;
+  header.file_size = nbytes;
+  memcpy(dst, &header, sizeof(header));
+  uint64_t size = sizeof(header);
+  for (uint64_t i = 0; i < nbytes; i += BLOCK_SIZE) {
+    uint64_t bits = 0;
+    BlockHeader block = {nbytes - i < BLOCK_SIZE ? nbytes - i : BLOCK_SIZE, 0};
+    block.size = encode_block(src + i, block.raw_size,
+                              dst + size + sizeof(block), 0, 1, false,
+                              &bits);
+    if (block.size == 0) {
+      return -1;
+    }
+    memcpy(dst + size, &block, sizeof(block));
+    size += sizeof(block) + block.size;
+  }
+  return size;
+}
+
+// takes in source buffer of size bytes, destination buffer of capacity bytes
+// decompresses a block format file held in src into dst, without allocating
+// returns the number of bytes stored in dst, -1 if src is invalid or does not
+// fit in dst
+int64_t decompress(uint8_t *src, uint64_t size, uint8_t *dst,
+                   uint64_t capacity) {
+  Header header;
+  if (size < sizeof(header)) {
+    return -1;
+  }
+  memcpy(&header, src, sizeof(header));
+  bool streamed = header.flags & FLAG_STREAMED;
+  if (header.magic != MAGIC_VERSIONED || header.version != VERSION_BLOCKS ||
+      (!streamed && header.file_size > capacity)) {
+    return -1;
+  }
+  uint64_t remaining = streamed ? capacity : header.file_size;
+  uint64_t offset = sizeof(header);
+  uint64_t written = 0;
+  while (streamed || written < header.file_size) {
+    BlockHeader block;
+    if (size - offset < sizeof(block)) {
+      return -1;
+    }
+    memcpy(&block, src + offset, sizeof(block));
+    offset += sizeof(block);
+    if (streamed && block.raw_size == 0 && block.size == 0) {
+      break; // end of a stream of unknown size
+    }
+    if (block.raw_size == 0 || block.raw_size > remaining ||
+        block.size > size - offset ||
+        !decode_block(src + offset, block.size, dst + written, block.raw_size,
+                      header.flags)) {
+      return -1;
+    }
+    offset += block.size;
+    written += block.raw_size;
+    remaining -= block.raw_size;
+  }
+  return written;
+}
+
+// takes in source buffer of size bytes, offset and length of a range of the
+// decompressed file, destination buffer of capacity bytes
+// decompresses only the blocks of src holding bytes offset to offset + length
+// and stores those bytes in dst; blocks before the range are passed over by
+// their headers. Blocks wholly inside the range decode straight into dst, the
+// partial blocks at either end through a buffer allocated to their size
+// returns the number of bytes stored in dst, less than length if the file
+// ends first, -1 if src is invalid, the range does not fit in dst or out of
+// memory
+int64_t decompress_range(uint8_t *src, uint64_t size, uint64_t offset,
+                         uint64_t length, uint8_t *dst, uint64_t capacity) {
+  Header header;
+  if (size < sizeof(header)) {
+    return -1;
+  }
+  memcpy(&header, src, sizeof(header));
+  bool streamed = header.flags & FLAG_STREAMED;
+  if (header.magic != MAGIC_VERSIONED || header.version != VERSION_BLOCKS) {
+    return -1;
+  }
+  uint64_t end = length < UINT64_MAX - offset ? offset + length : UINT64_MAX;
+  uint64_t position = sizeof(header);
+  uint64_t start = 0; // offset of the next block in the decompressed file
+  uint64_t written = 0;
+  uint8_t *scratch = NULL;
+  uint32_t largest = 0; // bytes in scratch
+  bool ok = true;
+  while (ok && start < end && (streamed || start < header.file_size)) {
+    BlockHeader block;
+    if (size - position < sizeof(block)) {
+      ok = false;
+      break;
+    }
+    memcpy(&block, src + position, sizeof(block));
+    position += sizeof(block);
+    if (streamed && block.raw_size == 0 && block.size == 0) {
+      break; // end of a stream of unknown size
+    }
+    uint64_t from = offset > start ? offset - start : 0;
+    uint64_t to = end - start < block.raw_size ? end - start : block.raw_size;
+    if (block.raw_size == 0 || block.raw_size > MAX_BLOCK_SIZE ||
+        block.size > size - position ||
+        (from < to && to - from > capacity - written)) {
+      ok = false;
+    } else if (from == 0 && to == block.raw_size) { // wholly inside the range
+      ok = decode_block(src + position, block.size, dst + written,
+                        block.raw_size, header.flags);
+    } else if (from < to) {
+      if (block.raw_size > largest) { // sized to the blocks the range cuts
+        free(scratch);
+        largest = block.raw_size;
+        scratch = (uint8_t *)malloc(largest);
+      }
+      ok = scratch && decode_block(src + position, block.size, scratch,
+                                   block.raw_size, header.flags);
+      if (ok) {
+        memcpy(dst + written, scratch + from, to - from);
+      }
+    }
+    written += from < to ? to - from : 0;
+    position += block.size;
+    start += block.raw_size;
+  }
+  free(scratch);
+  return ok ? (int64_t)written : -1;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "defines.h"
+#include <stdint.h>
+
+uint64_t compress_bound(uint64_t nbytes);
+
+int64_t compress(uint8_t *src, uint64_t nbytes, uint8_t *dst,
+                 uint64_t capacity);
+
+int64_t decompress(uint8_t *src, uint64_t size, uint8_t *dst,
+                   uint64_t capacity);
+
+int64_t decompress_range(uint8_t *src, uint64_t size, uint64_t offset,
+                         uint64_t length, uint8_t *dst, uint64_t capacity);
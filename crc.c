@@ -0,0 +1,84 @@
+#include "crc.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC_X86
+#endif
+
+#define POLY 0x82F63B78 // reflected Castagnoli polynomial
+
+static uint32_t table[8][256]; // slicing-by-8 tables
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+// fills the slicing-by-8 tables, table[k][b] advancing b by k more zero bytes
+static void init_table(void) {
+  for (uint32_t b = 0; b < 256; b += 1) {
+    uint32_t crc = b;
+    for (uint32_t i = 0; i < 8; i += 1) {
+      crc = (crc >> 1) ^ (POLY & -(crc & 1));
+    }
+    table[0][b] = crc;
+  }
+  for (uint32_t b = 0; b < 256; b += 1) {
+    for (uint32_t k = 1; k < 8; k += 1) {
+      table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xFF];
+    }
+  }
+}
+
+// takes in inverted crc, buffer, number of bytes
+// advances crc over nbytes of buf eight bytes at a time with the tables
+// returns inverted crc
+static uint32_t crc_table(uint32_t crc, uint8_t *buf, uint64_t nbytes) {
+  pthread_once(&once, init_table);
+  uint64_t i = 0;
+  for (; i + 8 <= nbytes; i += 8) {
+    uint64_t word;
+    memcpy(&word, buf + i, 8);
+    word ^= crc;
+    crc = table[7][word & 0xFF] ^ table[6][(word >> 8) & 0xFF] ^
+          table[5][(word >> 16) & 0xFF] ^ table[4][(word >> 24) & 0xFF] ^
+          table[3][(word >> 32) & 0xFF] ^ table[2][(word >> 40) & 0xFF] ^
+          table[1][(word >> 48) & 0xFF] ^ table[0][word >> 56];
+  }
+  for (; i < nbytes; i += 1) {
+    crc = (crc >> 8) ^ table[0][(crc ^ buf[i]) & 0xFF];
+  }
+  return crc;
+}
+
+#ifdef CRC_X86
+// takes in inverted crc, buffer, number of bytes
+// advances crc over nbytes of buf with the SSE4.2 crc32 instruction, eight
+// bytes at a time
+// returns inverted crc
+__attribute__((target("sse4.2"))) static uint32_t
+crc_sse42(uint32_t crc, uint8_t *buf, uint64_t nbytes) {
+  uint64_t c = crc;
+  uint64_t i = 0;
+  for (; i + 8 <= nbytes; i += 8) {
+    uint64_t word;
+    memcpy(&word, buf + i, 8);
+    c = _mm_crc32_u64(c, word);
+  }
+  for (; i < nbytes; i += 1) {
+    c = _mm_crc32_u8(c, buf[i]);
+  }
+  return c;
+}
+#endif
+
+// takes in crc of the bytes before buf, 0 to start, buffer, number of bytes
+// computes the CRC32C of the bytes before and buf, with the SSE4.2
+// instruction where the CPU has it
+// returns crc
+uint32_t crc32c(uint32_t crc, uint8_t *buf, uint64_t nbytes) {
+#ifdef CRC_X86
+  if (__builtin_cpu_supports("sse4.2")) {
+    return ~crc_sse42(~crc, buf, nbytes);
+  }
+#endif
+  return ~crc_table(~crc, buf, nbytes);
+}
@@ -1,7 +1,16 @@
+#include "adaptive.h"
+#include "batch.h"
+#include "block.h"
+#include "crc.h"
 #include "defines.h"
 #include "header.h"
 #include "huffman.h"
 #include "io.h"
+#include "pool.h"
+#include "registry.h"
+#include "ring.h"
+#include "stats.h"
+#include "table.h"
 
 #include <fcntl.h>
 #include <getopt.h>
@@ -9,11 +18,29 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#define OPTIONS "hvi:o:" // Valid inputs
+#define OPTIONS "hvJtj:d:m:r:i:o:" // Valid inputs
+#define OPT_OFFSET 256                   // --offset, no short form
+#define OPT_LENGTH 257                   // --length, no short form
+
+static struct option long_options[] = {
+    {"offset", required_argument, NULL, OPT_OFFSET},
+    {"length", required_argument, NULL, OPT_LENGTH},
+    {NULL, 0, NULL, 0}};
+
+// how to decompress, the same for every file of a batch
+typedef struct {
+  uint32_t threads;   // threads decoding indexed blocks
+  Registry *tables;   // trained tables, prepared once for every file
+  bool test;          // decode and verify without writing
+  bool range;         // decode only the bytes from offset
+  uint64_t offset;    // first byte of the range
+  uint64_t length;    // bytes in the range, UINT64_MAX for the rest
+} Settings;
 
 // prints help page
 static void help() {
@@ -22,12 +49,35 @@ static void help() {
   fprintf(stderr,
           "  Decompresses a file using the Huffman coding algorithm.\n\n");
   fprintf(stderr, "USAGE\n");
-  fprintf(stderr, "  ./decode [-h] [-i infile] [-o outfile]\n\n");
+  fprintf(stderr, "  ./decode [-h] [-v] [-J] [-t] [-j threads] [-d table]"
+                  " [-i infile] [-o outfile]\n");
+  fprintf(stderr, "  ./decode [-t] [-j threads] [-d table] [-m manifest]"
+                  " [-r directory] [file ...]\n");
+  fprintf(stderr, "  ./decode --offset X [--length Y] [-i infile]"
+                  " [-o outfile]\n\n");
   fprintf(stderr, "OPTIONS\n");
   fprintf(stderr, "  -h             Program usage and help.\n");
-  fprintf(stderr, "  -v             Print compression statistics.\n");
+  fprintf(stderr, "  -v             Print compression statistics and time "
+                  "per phase.\n");
+  fprintf(stderr, "  -J             Print the statistics as JSON, implies "
+                  "-v.\n");
+  fprintf(stderr, "  -t             Test: decode and verify checksums without "
+                  "writing.\n");
+  fprintf(stderr, "  -j threads     Decode indexed blocks on threads.\n");
+  fprintf(stderr, "  -d table       Load a trained table, may be repeated.\n");
+  fprintf(stderr, "  --offset X     Decode only from byte X of a block file, "
+                  "K, M or G suffix.\n");
+  fprintf(stderr, "  --length Y     Decode only Y bytes from --offset "
+                  "(default to the end).\n");
   fprintf(stderr, "  -i infile      Input file to decompress.\n");
   fprintf(stderr, "  -o outfile     Output of decompressed data.\n");
+  fprintf(stderr, "  -m manifest    Decompress each file listed in manifest, "
+                  "removing %s.\n",
+          BATCH_SUFFIX);
+  fprintf(stderr, "  -r directory   Decompress each %s file under directory.\n",
+          BATCH_SUFFIX);
+  fprintf(stderr, "  file ...       Decompress each file, on -j threads at "
+                  "once, sharing\n                 threads left over.\n");
 }
 
 // closes files after used by program
@@ -36,21 +86,766 @@ static void close_files(int infile, int outfile) {
   close(outfile);
 }
 
+// takes in infile and outfile descriptors, mapping of infile or NULL, size of
+// the mapping, header of infile
+// decompresses a single Huffman coded stream, stored after a tree dump or
+// canonical code lengths
+// returns boolean if successful
+static bool decode_stream(int infile, int outfile, uint8_t *map, uint64_t size,
+                          Header *header) {
+  Code code_table[ALPHABET] = {0};
+  Tree *tree = NULL;
+  if (header->magic == MAGIC) {
+    // read the dumped tree from infile into an array
+    if (header->tree_size == 0 || header->tree_size > MAX_TREE_SIZE) {
+      fprintf(stderr, "Error: Invalid tree dump\n");
+      return false;
+    }
+    uint8_t tree_dump[header->tree_size];
+    read_bytes(infile, tree_dump, header->tree_size);
+
+    // reconstruct the Huffman tree and take its codes
+    stats_phase(PHASE_TREE);
+    tree = rebuild_tree(header->tree_size, tree_dump);
+    if (!tree) {
+      fprintf(stderr, "Error: Invalid tree dump\n");
+      return false;
+    }
+    stats_phase(PHASE_CODES);
+    build_codes(tree, code_table);
+  } else {
+    // canonical codes follow from the code lengths alone
+    uint8_t lengths[ALPHABET];
+    if (!read_lengths(infile, lengths)) {
+      fprintf(stderr, "Error: Invalid code lengths\n");
+      return false;
+    }
+    stats_phase(PHASE_CODES);
+    PackedCode packed_table[ALPHABET];
+    canonical_codes(lengths, packed_table);
+    for (uint32_t i = 0; i < ALPHABET; i += 1) {
+      code_table[i] = code_unpack(&packed_table[i]);
+    }
+  }
+
+  // build the lookup table from the codes
+  DecodeTable *table = table_create(code_table);
+
+  // decode infile a block of symbols at a time
+  stats_phase(PHASE_CODING);
+  BitReader reader;
+  uint8_t read_buffer[BLOCK];
+  uint64_t offset = lseek(infile, 0, SEEK_CUR);
+  if (map && offset <= size) { // read the bitstream in place
+    bit_reader_init(&reader, -1, map + offset, size - offset);
+    bytes_read += size - offset;
+  } else {
+    bit_reader_init(&reader, infile, read_buffer, BLOCK);
+  }
+  uint64_t remaining = header->file_size;
+  uint8_t buf[BLOCK];
+  while (remaining > 0) {
+    uint64_t nbytes = remaining < BLOCK ? remaining : BLOCK;
+    uint64_t decoded = table_decode(table, &reader, buf, nbytes);
+    write_bytes(outfile, buf, decoded);
+    remaining -= decoded;
+    if (decoded < nbytes) {
+      fprintf(stderr, "Error: corrupt bitstream\n");
+      break;
+    }
+  }
+  stats_phase(PHASE_OTHER);
+
+  table_delete(&table);
+  tree_delete(&tree);
+  return remaining == 0;
+}
+
+// takes in infile and outfile descriptors, mapping of infile or NULL, size of
+// the mapping, header of infile
+// decompresses independently coded blocks, one at a time, checking the
+// checksum of their checksums after them with FLAG_CHECKSUM
+// returns boolean if successful
+static bool decode_blocks(int infile, int outfile, uint8_t *map, uint64_t size,
+                          Header *header) {
+  stats_phase(PHASE_CODING);
+  uint64_t offset = lseek(infile, 0, SEEK_CUR);
+  bool streamed = header->flags & FLAG_STREAMED;
+  uint64_t remaining = streamed ? UINT64_MAX : header->file_size;
+  uint32_t capacity = 0;
+  uint8_t *in = NULL;
+  uint8_t *out = NULL;
+  Ring *ring = NULL; // writes each block while the next one decodes
+  uint32_t checksum = 0;
+  bool ok = true;
+  while (ok && remaining > 0) {
+    BlockHeader block;
+    bool read = false;
+    if (map && size - offset >= sizeof(block)) {
+      memcpy(&block, map + offset, sizeof(block));
+      offset += sizeof(block);
+      bytes_read += sizeof(block);
+      read = true;
+    } else if (!map) {
+      read = read_bytes(infile, (uint8_t *)&block, sizeof(block)) ==
+             sizeof(block);
+    }
+    if (read && streamed && block.raw_size == 0 && block.size == 0) {
+      break; // end of a stream of unknown size
+    }
+    if (!read || block.raw_size == 0 || block.raw_size > MAX_BLOCK_SIZE ||
+        block.raw_size > remaining ||
+        block.size > block_bound(block.raw_size)) {
+      fprintf(stderr, "Error: Invalid block header\n");
+      ok = false;
+      break;
+    }
+    if (block_bound(block.raw_size) > capacity) { // grow the block buffers
+      capacity = block_bound(block.raw_size);
+      free(in);
+      in = map ? NULL : (uint8_t *)malloc(capacity);
+      ok = !ring || ring_finish(ring);
+      ring_delete(&ring);
+      ring = ring_create(-1, outfile, 0, capacity, 1, 3);
+      out = ring ? ring_buffer(ring) : NULL;
+      if (!ok || (!map && !in) || !out) {
+        fprintf(stderr, "Error: out of memory\n");
+        ok = false;
+        break;
+      }
+    }
+    uint8_t *src = in;
+    if (map && size - offset >= block.size) { // decode the block in place
+      src = map + offset;
+      offset += block.size;
+      bytes_read += block.size;
+      read = true;
+    } else {
+      read = !map && read_bytes(infile, in, block.size) == (int)block.size;
+    }
+    if (!read ||
+        !decode_block(src, block.size, out, block.raw_size, header->flags)) {
+      fprintf(stderr, "Error: corrupt block\n");
+      ok = false;
+      break;
+    }
+    if (header->flags & FLAG_CHECKSUM) {
+      checksum = crc32c(checksum, src + block.size - 4, 4);
+    }
+    ok = ring_write(ring, out, block.raw_size);
+    out = ring_buffer(ring);
+    remaining -= block.raw_size;
+  }
+  if (ok && (header->flags & FLAG_CHECKSUM)) {
+    uint32_t stored = ~checksum;
+    if (map && size - offset >= sizeof(stored)) {
+      memcpy(&stored, map + offset, sizeof(stored));
+      bytes_read += sizeof(stored);
+    } else if (!map) {
+      read_bytes(infile, (uint8_t *)&stored, sizeof(stored));
+    }
+    if (stored != checksum) {
+      fprintf(stderr, "Error: file checksum mismatch\n");
+      ok = false;
+    }
+  }
+  ok = (!ring || ring_finish(ring)) && ok;
+  ring_delete(&ring);
+  free(in);
+  return ok;
+}
+
+// takes in infile and outfile descriptors
+// decompresses adaptive chunks one at a time, writing each as it arrives
+// returns boolean if successful
+static bool decode_adaptive(int infile, int outfile) {
+  stats_phase(PHASE_CODING);
+  Model *m = model_create();
+  uint8_t *in = (uint8_t *)malloc(adaptive_bound(ADAPT_CHUNK));
+  uint8_t *out = (uint8_t *)malloc(ADAPT_CHUNK);
+  bool ok = m && in && out;
+  while (ok) {
+    BlockHeader chunk;
+    if (read_bytes(infile, (uint8_t *)&chunk, sizeof(chunk)) !=
+            sizeof(chunk) ||
+        chunk.raw_size > ADAPT_CHUNK ||
+        chunk.size > adaptive_bound(chunk.raw_size)) {
+      fprintf(stderr, "Error: Invalid chunk header\n");
+      ok = false;
+      break;
+    }
+    if (chunk.raw_size == 0) { // end of the stream
+      break;
+    }
+    if (read_bytes(infile, in, chunk.size) != (int)chunk.size ||
+        !adaptive_decode(m, in, chunk.size, out, chunk.raw_size)) {
+      fprintf(stderr, "Error: corrupt chunk\n");
+      ok = false;
+      break;
+    }
+    write_bytes(outfile, out, chunk.raw_size);
+  }
+  model_delete(&m);
+  free(in);
+  free(out);
+  return ok;
+}
+
+// takes in infile and outfile descriptors, mapping of infile or NULL, size of
+// the mapping, header of infile, registry of trained tables
+// decompresses a stream coded with a trained table, whose prepared decode
+// table is shared with every other file using it, as a single bitstream or as
+// chunks through to an empty chunk
+// returns boolean if successful
+static bool decode_trained(int infile, int outfile, uint8_t *map,
+                           uint64_t size, Header *header, Registry *tables) {
+  uint32_t id = 0;
+  read_bytes(infile, (uint8_t *)&id, sizeof(id));
+  DecodeTable *table = tables ? registry_decoder(tables, id) : NULL;
+  if (!table) {
+    fprintf(stderr, "Error: table %08" PRIx32 " is not loaded\n", id);
+    return false;
+  }
+
+  stats_phase(PHASE_CODING);
+  BitReader reader;
+  uint8_t *in = (uint8_t *)malloc(registry_bound(ADAPT_CHUNK));
+  uint8_t *out = (uint8_t *)malloc(ADAPT_CHUNK);
+  bool ok = in && out;
+  uint64_t remaining = header->file_size;
+  if (ok && !(header->flags & FLAG_STREAMED)) {
+    uint64_t offset = lseek(infile, 0, SEEK_CUR);
+    if (map && offset <= size) { // read the bitstream in place
+      bit_reader_init(&reader, -1, map + offset, size - offset);
+      bytes_read += size - offset;
+    } else {
+      bit_reader_init(&reader, infile, in, ADAPT_CHUNK);
+    }
+    while (remaining > 0) {
+      uint64_t nbytes = remaining < ADAPT_CHUNK ? remaining : ADAPT_CHUNK;
+      uint64_t decoded = table_decode(table, &reader, out, nbytes);
+      write_bytes(outfile, out, decoded);
+      remaining -= decoded;
+      if (decoded < nbytes) {
+        fprintf(stderr, "Error: corrupt bitstream\n");
+        break;
+      }
+    }
+    ok = remaining == 0;
+  }
+  while (ok && (header->flags & FLAG_STREAMED)) {
+    BlockHeader chunk;
+    if (read_bytes(infile, (uint8_t *)&chunk, sizeof(chunk)) !=
+            sizeof(chunk) ||
+        chunk.raw_size > ADAPT_CHUNK ||
+        chunk.size > registry_bound(chunk.raw_size)) {
+      fprintf(stderr, "Error: Invalid chunk header\n");
+      ok = false;
+      break;
+    }
+    if (chunk.raw_size == 0) { // end of the stream
+      break;
+    }
+    if (read_bytes(infile, in, chunk.size) != (int)chunk.size) {
+      fprintf(stderr, "Error: corrupt chunk\n");
+      ok = false;
+      break;
+    }
+    bit_reader_init(&reader, -1, in, chunk.size);
+    if (table_decode(table, &reader, out, chunk.raw_size) != chunk.raw_size) {
+      fprintf(stderr, "Error: corrupt chunk\n");
+      ok = false;
+      break;
+    }
+    write_bytes(outfile, out, chunk.raw_size);
+  }
+  stats_phase(PHASE_OTHER);
+  free(in);
+  free(out);
+  return ok;
+}
+
+// takes in infile descriptor, header of infile, pointer for the number of
+// blocks
+// reads and checks the block index at the end of infile
+// returns array of index entries, NULL if infile has no usable index
+static IndexEntry *read_index(int infile, Header *header, uint32_t *blocks) {
+  struct stat stats;
+  IndexFooter footer;
+  if (!(header->flags & FLAG_INDEX) || fstat(infile, &stats) == -1 ||
+      !S_ISREG(stats.st_mode) ||
+      (uint64_t)stats.st_size < sizeof(Header) + sizeof(footer) ||
+      pread_bytes(infile, (uint8_t *)&footer, sizeof(footer),
+                  stats.st_size - sizeof(footer)) != sizeof(footer) ||
+      footer.magic != INDEX_MAGIC || footer.blocks == 0 ||
+      footer.offset > (uint64_t)stats.st_size - sizeof(footer) ||
+      footer.offset + (uint64_t)footer.blocks * sizeof(IndexEntry) !=
+          stats.st_size - sizeof(footer)) {
+    return NULL;
+  }
+  // bounded by the file size above, and by what one pread_bytes can read
+  uint64_t size = (uint64_t)footer.blocks * sizeof(IndexEntry);
+  if (size > INT32_MAX) {
+    return NULL;
+  }
+  IndexEntry *entries = (IndexEntry *)malloc(size + sizeof(IndexEntry));
+  if (!entries || pread_bytes(infile, (uint8_t *)entries, size,
+                              footer.offset) != (int)size) {
+    free(entries);
+    return NULL;
+  }
+  uint64_t offset = sizeof(Header);
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < footer.blocks; i += 1) { // blocks must tile infile
+    if (entries[i].offset != offset || entries[i].raw_size == 0 ||
+        entries[i].raw_size > MAX_BLOCK_SIZE ||
+        entries[i].size > block_bound(entries[i].raw_size)) {
+      free(entries);
+      return NULL;
+    }
+    offset += sizeof(BlockHeader) + entries[i].size;
+    total += entries[i].raw_size;
+  }
+  if (header->flags & FLAG_STREAMED) { // the size follows from the index
+    offset += sizeof(BlockHeader);
+    header->file_size = total;
+  }
+  if (header->flags & FLAG_CHECKSUM) {
+    offset += sizeof(uint32_t);
+  }
+  if (offset != footer.offset || total != header->file_size) {
+    free(entries);
+    return NULL;
+  }
+  *blocks = footer.blocks;
+  return entries;
+}
+
+// a block of infile located through the index, decoded on the thread pool
+typedef struct {
+  Task task;
+  int infile;
+  int outfile;         // written in place when seekable, -1 otherwise
+  uint8_t *map;        // mapping of infile read in place, or NULL
+  IndexEntry entry;
+  uint64_t raw_offset; // offset of the block in the decompressed file
+  uint8_t flags;       // flags of the file header
+  uint32_t crc;        // stored CRC32C of the block with FLAG_CHECKSUM
+  uint8_t *in;
+  uint8_t *out;
+  bool ok;
+} Job;
+
+// takes in Job
+// reads, decodes and, for a seekable outfile, writes the block of the job
+static void decompress_job(void *arg) {
+  Job *j = (Job *)arg;
+  IndexEntry *e = &j->entry;
+  BlockHeader block;
+  int32_t size = e->size;
+  uint8_t *in = j->in;
+  if (j->map) { // read_index checked the blocks lie within infile
+    memcpy(&block, j->map + e->offset, sizeof(block));
+    in = j->map + e->offset + sizeof(block);
+  } else if (pread_bytes(j->infile, (uint8_t *)&block, sizeof(block),
+                         e->offset) != sizeof(block) ||
+             pread_bytes(j->infile, j->in, size, e->offset + sizeof(block)) !=
+                 size) {
+    j->ok = false;
+    return;
+  }
+  j->ok = block.raw_size == e->raw_size && block.size == e->size &&
+          decode_block(in, e->size, j->out, e->raw_size, j->flags);
+  if (j->ok && (j->flags & FLAG_CHECKSUM)) {
+    memcpy(&j->crc, in + e->size - sizeof(j->crc), sizeof(j->crc));
+  }
+  if (j->ok && j->outfile >= 0) {
+    j->ok = pwrite_bytes(j->outfile, j->out, e->raw_size, j->raw_offset) ==
+            (int32_t)e->raw_size;
+  }
+}
+
+// takes in infile and outfile descriptors, mapping of infile or NULL, header
+// of infile, index entries, number of blocks, number of threads
+// decompresses the indexed blocks in parallel, writing each in place when
+// outfile is seekable and otherwise in order, with at most two blocks per
+// thread in memory
+// returns boolean if successful
+static bool decode_indexed(int infile, int outfile, uint8_t *map,
+                           Header *header, IndexEntry *entries,
+                           uint32_t blocks, uint32_t threads) {
+  stats_phase(PHASE_CODING); // mostly waiting on the decoder threads
+  uint32_t largest = 0;
+  for (uint32_t i = 0; i < blocks; i += 1) {
+    largest = entries[i].raw_size > largest ? entries[i].raw_size : largest;
+  }
+  off_t start = lseek(outfile, 0, SEEK_CUR);
+  // appending ignores the pwrite offset, so blocks would land out of order
+  bool in_place = start != -1 && !(fcntl(outfile, F_GETFL) & O_APPEND);
+  uint32_t slots = 2 * threads;
+  Pool *pool = pool_create(threads);
+  Job *jobs = (Job *)calloc(slots, sizeof(Job));
+  bool ok = pool && jobs;
+  for (uint32_t i = 0; ok && i < slots; i += 1) {
+    jobs[i].task.run = decompress_job;
+    jobs[i].task.arg = &jobs[i];
+    jobs[i].infile = infile;
+    jobs[i].map = map;
+    jobs[i].flags = header->flags;
+    jobs[i].outfile = in_place ? outfile : -1;
+    jobs[i].in = map ? NULL : (uint8_t *)malloc(block_bound(largest));
+    jobs[i].out = (uint8_t *)malloc(largest);
+    ok = (map || jobs[i].in) && jobs[i].out;
+  }
+
+  uint64_t raw_offset = in_place ? start : 0;
+  uint32_t submitted = 0;
+  uint32_t finished = 0;
+  uint32_t checksum = 0;
+  while (ok && submitted < blocks) {
+    if (submitted - finished == slots) { // reuse the oldest slot
+      Job *oldest = &jobs[finished % slots];
+      pool_wait(pool, &oldest->task);
+      ok = oldest->ok;
+      checksum = crc32c(checksum, (uint8_t *)&oldest->crc, 4);
+      if (ok && !in_place) {
+        write_bytes(outfile, oldest->out, oldest->entry.raw_size);
+      }
+      finished += 1;
+    }
+    Job *j = &jobs[submitted % slots];
+    j->entry = entries[submitted];
+    j->raw_offset = raw_offset;
+    raw_offset += j->entry.raw_size;
+    pool_submit(pool, &j->task);
+    submitted += 1;
+  }
+  for (; finished < submitted; finished += 1) { // blocks still in flight
+    Job *j = &jobs[finished % slots];
+    pool_wait(pool, &j->task);
+    ok = ok && j->ok;
+    checksum = crc32c(checksum, (uint8_t *)&j->crc, 4);
+    if (ok && !in_place) {
+      write_bytes(outfile, j->out, j->entry.raw_size);
+    }
+  }
+  IndexEntry *last = &entries[blocks - 1];
+  uint64_t end = last->offset + sizeof(BlockHeader) + last->size;
+  if (header->flags & FLAG_STREAMED) {
+    end += sizeof(BlockHeader);
+  }
+  if (ok && (header->flags & FLAG_CHECKSUM)) { // read_index checked it fits
+    uint32_t stored = ~checksum;
+    if (map) {
+      memcpy(&stored, map + end, sizeof(stored));
+    } else {
+      pread_bytes(infile, (uint8_t *)&stored, sizeof(stored), end);
+    }
+    if (stored != checksum) {
+      fprintf(stderr, "Error: file checksum mismatch\n");
+      ok = false;
+    }
+    end += sizeof(stored);
+  }
+  if (ok) { // account for the positioned reads and writes
+    bytes_read += end - sizeof(Header) + blocks * sizeof(IndexEntry) +
+                  sizeof(IndexFooter);
+  }
+  if (ok && in_place) {
+    bytes_written += raw_offset - start;
+    lseek(outfile, raw_offset, SEEK_SET);
+  }
+
+  pool_delete(&pool);
+  for (uint32_t i = 0; jobs && i < slots; i += 1) {
+    free(jobs[i].in);
+    free(jobs[i].out);
+  }
+  free(jobs);
+  return ok;
+}
+
+// takes in infile descriptor, mapping of infile or NULL, size of the mapping,
+// file offset, number of bytes, buffer of at least nbytes, whether infile
+// can be read at any offset
+// returns the nbytes at offset of infile, in place in the mapping or read
+// into buf, or for a pipe the next nbytes; NULL if infile ends first
+static uint8_t *read_at(int infile, uint8_t *map, uint64_t size,
+                        uint64_t offset, uint32_t nbytes, uint8_t *buf,
+                        bool seekable) {
+  if (map) {
+    if (offset > size || nbytes > size - offset) {
+      return NULL;
+    }
+    bytes_read += nbytes;
+    return map + offset;
+  }
+  if (!seekable) {
+    return read_bytes(infile, buf, nbytes) == (int)nbytes ? buf : NULL;
+  }
+  if (pread_bytes(infile, buf, nbytes, offset) != (int)nbytes) {
+    return NULL;
+  }
+  bytes_read += nbytes;
+  return buf;
+}
+
+// takes in infile and outfile descriptors, mapping of infile or NULL, size of
+// the mapping, header of infile, index entries or NULL, number of blocks,
+// offset and length of the range
+// decompresses only the blocks holding bytes offset to offset + length of
+// the decompressed file and writes those bytes: blocks before the range are
+// passed over through the index without reading them, or without an index
+// by their block headers alone
+// returns boolean if successful
+static bool decode_range(int infile, int outfile, uint8_t *map, uint64_t size,
+                         Header *header, IndexEntry *entries, uint32_t blocks,
+                         uint64_t offset, uint64_t length) {
+  stats_phase(PHASE_CODING);
+  bool streamed = header->flags & FLAG_STREAMED;
+  bool seekable = lseek(infile, 0, SEEK_CUR) != -1;
+  uint64_t end = length < UINT64_MAX - offset ? offset + length : UINT64_MAX;
+  uint64_t position = sizeof(Header); // file offset of the next block
+  uint64_t start = 0; // offset of the next block in the decompressed file
+  uint32_t capacity = 0;
+  uint8_t *in = NULL;
+  uint8_t *out = NULL;
+  bool ok = true;
+  for (uint32_t i = 0; ok && start < end; i += 1) {
+    if (entries && i == blocks) {
+      break;
+    }
+    if (entries && start + entries[i].raw_size <= offset) {
+      start += entries[i].raw_size; // never read
+      continue;
+    }
+    if (!entries && !streamed && start == header->file_size) {
+      break;
+    }
+    BlockHeader block;
+    uint8_t *src = read_at(infile, map, size, entries ? entries[i].offset
+                                                      : position,
+                           sizeof(block), (uint8_t *)&block, seekable);
+    if (src && src != (uint8_t *)&block) { // not already read into block
+      memcpy(&block, src, sizeof(block));
+    }
+    if (src && streamed && block.raw_size == 0 && block.size == 0) {
+      break; // end of a stream of unknown size
+    }
+    if (!src || block.raw_size == 0 || block.raw_size > MAX_BLOCK_SIZE ||
+        block.size > block_bound(block.raw_size) ||
+        (entries && (block.raw_size != entries[i].raw_size ||
+                     block.size != entries[i].size))) {
+      fprintf(stderr, "Error: Invalid block header\n");
+      ok = false;
+      break;
+    }
+    position = (entries ? entries[i].offset : position) + sizeof(block);
+    bool wanted = start + block.raw_size > offset;
+    if (!wanted && seekable) { // passed over by its header
+      position += block.size;
+      start += block.raw_size;
+      continue;
+    }
+    if (block_bound(block.raw_size) > capacity) { // grow the block buffers
+      capacity = block_bound(block.raw_size);
+      free(in);
+      free(out);
+      in = (uint8_t *)malloc(capacity);
+      out = (uint8_t *)malloc(capacity);
+      if (!in || !out) {
+        fprintf(stderr, "Error: out of memory\n");
+        ok = false;
+        break;
+      }
+    }
+    src = read_at(infile, map, size, position, block.size, in, seekable);
+    position += block.size;
+    if (!wanted) { // a pipe is read through to the range
+      ok = src != NULL;
+      start += block.raw_size;
+      continue;
+    }
+    if (!src ||
+        !decode_block(src, block.size, out, block.raw_size, header->flags)) {
+      fprintf(stderr, "Error: corrupt block\n");
+      ok = false;
+      break;
+    }
+    uint64_t from = offset > start ? offset - start : 0;
+    uint64_t to = end - start < block.raw_size ? end - start : block.raw_size;
+    write_bytes(outfile, out + from, to - from);
+    start += block.raw_size;
+  }
+  stats_phase(PHASE_OTHER);
+  free(in);
+  free(out);
+  return ok;
+}
+
+// takes in infile and outfile descriptors, Settings
+// sets the permissions of outfile to those stored in infile and decompresses
+// infile in whichever format its header names
+// returns boolean if successful
+static bool decode_file(int infile, int outfile, void *arg) {
+  Settings *s = (Settings *)arg;
+  stats_phase(PHASE_HEADER);
+  Header header;
+  // read in the header from infile and verify the magic number and version
+  if (read_bytes(infile, (uint8_t *)&header, sizeof(Header)) !=
+          sizeof(Header) ||
+      (header.magic != MAGIC &&
+       (header.magic != MAGIC_VERSIONED ||
+        (header.version != VERSION_CANONICAL &&
+         header.version != VERSION_BLOCKS &&
+         header.version != VERSION_ADAPTIVE &&
+         header.version != VERSION_TRAINED)))) {
+    fprintf(stderr, "Error: Invalid header\n");
+    return false;
+  }
+
+  // set the permissions, or test infile without writing anything
+  if (s->test) {
+    outfile = -1;
+  } else {
+    fchmod(outfile, header.permissions);
+  }
+
+  // read a regular infile in place, and anything else through read_bytes
+  uint64_t size = 0;
+  uint8_t *map = map_input(infile, &size);
+
+  // decompress a single stream, or independent blocks in parallel through
+  // the index when there is one and otherwise in sequence
+  bool ok;
+  uint32_t blocks = 0;
+  IndexEntry *entries = NULL;
+  if (s->range && (header.magic != MAGIC_VERSIONED ||
+                   header.version != VERSION_BLOCKS)) {
+    fprintf(stderr, "Error: --offset and --length need a block file\n");
+    ok = false;
+  } else if (s->range) {
+    stats_phase(PHASE_HEADER);
+    entries = read_index(infile, &header, &blocks);
+    ok = decode_range(infile, outfile, map, size, &header, entries, blocks,
+                      s->offset, s->length);
+    free(entries);
+  } else if (header.magic == MAGIC_VERSIONED &&
+             header.version == VERSION_BLOCKS) {
+    if (s->threads > 1) {
+      stats_phase(PHASE_HEADER);
+      entries = read_index(infile, &header, &blocks);
+    }
+    if (entries) {
+      ok = decode_indexed(infile, outfile, map, &header, entries, blocks,
+                          s->threads);
+      free(entries);
+    } else {
+      ok = decode_blocks(infile, outfile, map, size, &header);
+    }
+  } else if (header.magic == MAGIC_VERSIONED &&
+             header.version == VERSION_ADAPTIVE) {
+    ok = decode_adaptive(infile, outfile);
+  } else if (header.magic == MAGIC_VERSIONED &&
+             header.version == VERSION_TRAINED) {
+    ok = decode_trained(infile, outfile, map, size, &header, s->tables);
+  } else {
+    ok = decode_stream(infile, outfile, map, size, &header);
+  }
+  stats_phase(PHASE_OTHER);
+  unmap_input(map, size);
+  return ok;
+}
+
+// takes in count argument, with an optional K, M or G suffix, pointer for the
+// count
+// returns boolean if the argument is a count
+static bool parse_count(char *arg, uint64_t *count) {
+  char *end = NULL;
+  if (*arg < '0' || *arg > '9') {
+    return false;
+  }
+  *count = strtoull(arg, &end, 10);
+  uint32_t shift = 0;
+  if (*end == 'K' || *end == 'k') {
+    shift = 10;
+  } else if (*end == 'M' || *end == 'm') {
+    shift = 20;
+  } else if (*end == 'G' || *end == 'g') {
+    shift = 30;
+  }
+  end += shift > 0;
+  if (*end != '\0' || *count > UINT64_MAX >> shift) {
+    return false;
+  }
+  *count <<= shift;
+  return true;
+}
+
 // driver code of program
 int main(int argc, char **argv) {
   int opt = 0;
   bool verbose = false;
+  bool json = false;
+  Settings s = {1, NULL, false, false, 0, UINT64_MAX};
   int infile = 0;
   int outfile = 1;
+  FileList batch = {NULL, 0, 0};
+  uint32_t id = 0;
+  bool ok = true;
 
-  while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+  while ((opt = getopt_long(argc, argv, OPTIONS, long_options, NULL)) != -1) {
     switch (opt) {
+    case OPT_OFFSET:
+    case OPT_LENGTH:
+      if (!parse_count(optarg, opt == OPT_OFFSET ? &s.offset : &s.length)) {
+        fprintf(stderr, "Error: invalid %s\n",
+                opt == OPT_OFFSET ? "offset" : "length");
+        return 1;
+      }
+      s.range = true;
+      break;
     case 'h':
       help();
       return 0; // print help page
     case 'v':
       verbose = true;
       break; // print verbose output
+    case 'J':
+      verbose = true;
+      json = true;
+      break; // print verbose output as JSON
+    case 't':
+      s.test = true;
+      break;
+    case 'j':
+      s.threads = strtoul(optarg, NULL, 10);
+      if (s.threads == 0 || s.threads > MAX_THREADS) {
+        fprintf(stderr, "Error: thread count must be 1 to %d\n", MAX_THREADS);
+        return 1;
+      }
+      break;
+    case 'd':
+      s.tables = s.tables ? s.tables : registry_create();
+      id = 0;
+      if (!s.tables || !registry_load(s.tables, optarg, &id)) {
+        if (s.tables && registry_codes(s.tables, id)) {
+          fprintf(stderr, "Error: table %s has ID %08" PRIx32 ", the same as "
+                          "a different table loaded before it\n",
+                  optarg, id);
+        } else {
+          fprintf(stderr, "Error: failed to load table %s\n", optarg);
+        }
+        registry_delete(&s.tables);
+        return 1;
+      }
+      break;
+    case 'm':
+      ok = ok && list_manifest(&batch, optarg);
+      break;
+    case 'r':
+      ok = ok && list_walk(&batch, optarg, true);
+      break;
     case 'i':
       infile = open(optarg, O_RDONLY);
       if (infile == -1) {
@@ -71,64 +866,54 @@ int main(int argc, char **argv) {
     }
   }
 
-  Header header;
-  // read in the header from infile and verify the magic number
-  read_bytes(infile, (uint8_t *)&header, sizeof(Header));
-  if (header.magic != MAGIC) {
-    fprintf(stderr, "Error: Invalid header");
-    return -1;
-  }
-
-  struct stat instatbuf;
-  // set the permissions
-  fstat(infile, &instatbuf);
-  fchmod(outfile, header.permissions);
-
-  // read the dumped tree from infile into an array
-  uint8_t tree_dump[header.tree_size];
-  read_bytes(infile, tree_dump, header.tree_size);
-
-  // reconstruct the Huffman tree
-  Node *root_node = NULL;
-  root_node = rebuild_tree(header.tree_size, tree_dump);
-
-  // Read infile one bit at a time
-  Node *node = root_node;
-  uint64_t bytes_writ = 0;
-  uint32_t index = 0;
-  uint8_t bit = 0;
-  uint8_t buf[BLOCK];
-  while (read_bit(infile, &bit) && bytes_writ < header.file_size) {
-    if (bit) {
-      node = node->right; // a bit of value 1 is read
-    } else {
-      node = node->left; // a bit of value 0 is read
-    }
-    if (node->left == NULL && node->right == NULL) { // leaf node
-      buf[index++] = node->symbol; // add the symbol to the buffer
-      bytes_writ++;
-      node = root_node;     // reset current node back to root
-      if (index == BLOCK) { // write buffer whenever it is filled
-        write_bytes(outfile, buf, BLOCK);
-        index = 0;
-      }
-    }
+  for (int i = optind; ok && i < argc; i += 1) {
+    ok = list_add(&batch, argv[i]);
+  }
+  if (!ok) {
+    fprintf(stderr, "Error: failed to list the files to decompress\n");
+    list_clear(&batch);
+    return 1;
   }
 
-  // write leftover bytes to buffer if any remain
-  write_bytes(outfile, buf, index);
+  // decompress a batch of files at once, one file per thread, and the
+  // threads left over on the indexed blocks of each file
+  if (batch.count > 0 && (infile != 0 || outfile != 1)) {
+    fprintf(stderr, "Error: -i and -o do not apply to a batch of files\n");
+    close_files(infile, outfile);
+    list_clear(&batch);
+    registry_delete(&s.tables);
+    return 1;
+  }
+  if (batch.count > 0) {
+    uint32_t workers = batch.count < s.threads ? batch.count : s.threads;
+    Settings one = {s.threads / workers, s.tables, s.test, s.range, s.offset,
+                    s.length};
+    ok = batch_run(&batch, workers, true, s.test, decode_file, &one);
+    list_clear(&batch);
+    registry_delete(&s.tables);
+    return ok ? 0 : 1;
+  }
 
   if (verbose) {
+    stats_start();
+  }
+  ok = decode_file(infile, outfile, &s);
+  stats_stop();
+
+  if (verbose && json) {
+    stats_print(bytes_written, bytes_read, true);
+  } else if (verbose) {
     fprintf(stderr, "Compressed file size: %" PRIu64 " bytes\n", bytes_read);
     fprintf(stderr, "Decompressed file size: %" PRIu64 " bytes\n",
             bytes_written);
     fprintf(stderr, "Space saving: %.2f%%\n",
             100 * (1 - ((double)bytes_read / bytes_written)));
+    stats_print(bytes_written, bytes_read, false);
   }
 
   // close infile and outfile
   close_files(infile, outfile);
+  registry_delete(&s.tables);
 
-  delete_tree(&root_node);
-  return 0;
+  return ok ? 0 : 1;
 }
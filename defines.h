@@ -2,6 +2,37 @@
 
 #define BLOCK 4096                       // 4KB blocks.
 #define ALPHABET 256                     // ASCII + Extended ASCII.
+#define HISTOGRAM_BUFFER (16 * BLOCK)    // 64KB reads for the histogram.
+#define PARALLEL_SLICE (1 << 24)         // 16MiB least histogram per thread.
 #define MAGIC 0xBEEFD00D                 // 32-bit magic number.
+#define MAGIC_VERSIONED 0xBEEFD00E       // Magic number of versioned formats.
+#define VERSION_CANONICAL 2              // Canonical code lengths format.
+#define VERSION_BLOCKS 3                 // Independently coded blocks format.
+#define VERSION_ADAPTIVE 4               // Adaptive code chunks format.
+#define VERSION_TRAINED 5                // Shared trained code format.
+#define INDEX_MAGIC 0xB10CBEEF            // Magic number of the block index.
+#define TABLE_MAGIC 0x7AB1EC0D            // Magic number of a table file.
+#define FLAG_INDEX 0x1                   // Blocks followed by an index.
+#define FLAG_STREAMS 0x2                 // Blocks split into bitstreams.
+#define FLAG_STREAMED 0x4                // Size unknown, empty block ends.
+#define FLAG_CONTEXT 0x8                 // Blocks may code by context.
+#define FLAG_CHECKSUM 0x10               // Blocks and file end in a CRC32C.
+#define MAX_STREAMS 16                   // Most bitstreams in a block.
+#define BLOCK_SIZE (1 << 20)             // 1MiB default coding block.
+#define MAX_BLOCK_SIZE (1 << 28)         // 256MiB largest coding block.
+#define MAX_THREADS 256                  // Most worker threads.
+#define BATCH_SUFFIX ".huff"             // Name added to compressed files.
 #define MAX_CODE_SIZE (ALPHABET / 8)     // Bytes for a maximum, 256-bit code.
 #define MAX_TREE_SIZE (3 * ALPHABET - 1) // Maximum Huffman tree dump size.
+#define MAX_NODES (2 * ALPHABET - 1)    // Nodes of a full Huffman tree.
+#define TABLE_BITS 11                    // Bits resolved per decode lookup.
+#define MAX_PACKED_BITS 64               // Longest code held in a PackedCode.
+#define MAX_LENGTHS_SIZE (2 + ALPHABET / 8 + ALPHABET) // Stored code lengths.
+#define ADAPT_CHUNK (16 * BLOCK)         // 64KB largest adaptive chunk.
+#define ADAPT_LIMIT 15                   // Longest adaptive code.
+#define ADAPT_MIN 32                     // Symbols before the first rebuild.
+#define ADAPT_INTERVAL (16 * BLOCK)      // Most symbols between rebuilds.
+#define ADAPT_WINDOW (1 << 18)           // Counts halve past this total.
+#define CONTEXT_GROUPS 16                // Most code tables of a block.
+#define CONTEXT_ROUNDS 4                 // Refinements of context groups.
+#define TRAINED_LIMIT 15                 // Longest trained code.
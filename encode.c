@@ -5,19 +5,45 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "adaptive.h"
+#include "batch.h"
+#include "block.h"
 #include "code.h"
+#include "crc.h"
 #include "defines.h"
 #include "header.h"
+#include "histogram.h"
 #include "huffman.h"
 #include "io.h"
 #include "node.h"
-#include "pq.h"
-#include "stack.h"
+#include "pool.h"
+#include "registry.h"
+#include "ring.h"
+#include "stats.h"
 
-#define OPTIONS "hvi:o:"
+#define OPTIONS "hvJcaxkl:j:b:s:e:d:g:m:r:i:o:"
+
+// how to compress, the same for every file of a batch
+typedef struct {
+  bool a_case;         // adaptive code
+  bool b_case;         // independent blocks
+  bool c_case;         // canonical code lengths
+  bool v_case;         // verbose
+  bool x_case;         // code blocks by context where it pays
+  bool k_case;         // checksum blocks and the file
+  uint32_t limit;      // maximum code length or 0
+  uint32_t threads;    // threads coding blocks
+  uint32_t cpus;       // threads counting a single stream
+  uint32_t streams;    // bitstreams per block
+  uint32_t block_size; // bytes per block
+  uint32_t samples;    // blocks sampled for the histogram, 0 to count all
+  Registry *tables;    // trained table to code with, or NULL
+  uint32_t table;      // ID of the trained table
+} Settings;
 
 // file descriptors for infile and outfile
 static int fd_in = STDIN_FILENO;
@@ -28,38 +54,704 @@ void print_help() {
   printf("SYNOPSIS\n  A Huffman encoder.\n  Compresses a file using the "
          "Huffman coding "
          "algorithm.\n\n");
-  printf("USAGE\n  ./encode [-h] [-i infile] [-o outfile]\n\n");
+  printf("USAGE\n  ./encode [-h] [-v] [-J] [-c] [-a] [-x] [-k] [-l length]"
+         " [-j threads]\n         [-b size] [-s streams] [-e samples]"
+         " [-i infile] [-o outfile]\n"
+         "  ./encode [options] [-m manifest] [-r directory] [file ...]\n"
+         "  ./encode -g table [-i infile] [-m manifest] [-r directory]"
+         " [file ...]\n\n");
   printf("OPTIONS\n");
   printf("  -h             Program usage and help.\n");
-  printf("  -v             Print compression statistics\n");
-  printf("  -i infile      Input file to compress.\n");
+  printf("  -v             Print compression statistics and time per "
+         "phase.\n");
+  printf("  -J             Print the statistics as JSON, implies -v.\n");
+  printf("  -c             Store canonical code lengths instead of the "
+         "tree.\n");
+  printf("  -a             Adapt the code as symbols pass, flushing each "
+         "read.\n");
+  printf("  -x             Code blocks with tables chosen by the previous "
+         "byte\n                 where that is smaller.\n");
+  printf("  -k             Store a CRC32C of each block and of the file.\n");
+  printf("  -l length      Limit codes to length bits, implies -c.\n");
+  printf("  -j threads     Code independent blocks on threads.\n");
+  printf("  -b size        Block size in bytes, K or M suffix (default 1M).\n");
+  printf("  -s streams     Split blocks into interleaved bitstreams.\n");
+  printf("  -e samples     Estimate the histogram from samples evenly "
+         "spaced reads.\n");
+  printf("  -d table       Code with a trained table in one pass, storing "
+         "no code.\n");
+  printf("  -g table       Train a table on the input files instead, and "
+         "print its ID.\n");
+  printf("  -i infile      Input file to compress, a pipe is streamed in "
+         "blocks.\n");
   printf("  -o outfile     Output of compressed data.\n");
+  printf("  -m manifest    Compress each file listed in manifest to file%s.\n",
+         BATCH_SUFFIX);
+  printf("  -r directory   Compress each file under directory.\n");
+  printf("  file ...       Compress each file, on -j threads at once.\n");
 }
 
-// constructs the histogram to store the frequencies of each unique symbol
+// constructs the histogram to store the frequencies of each unique symbol,
+// reading HISTOGRAM_BUFFER bytes at a time into read_buffer
+// returns the number of symbols that were not in the histogram yet
 uint32_t create_histogram(int infile, uint8_t *read_buffer,
                           uint64_t histogram[static ALPHABET], int bytes) {
   uint32_t unique_symbols = 0;
-  while ((bytes = read_bytes(infile, read_buffer, BLOCK)) > 0) {
-    for (int i = 0; i < bytes; i += 1) {
-      if (histogram[read_buffer[i]] == 0) {
-        unique_symbols += 1;
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    unique_symbols -= histogram[i] > 0;
+  }
+  while ((bytes = read_bytes(infile, read_buffer, HISTOGRAM_BUFFER)) > 0) {
+    histogram_add(read_buffer, bytes, histogram);
+  }
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    unique_symbols += histogram[i] > 0;
+  }
+  return unique_symbols;
+}
+
+// takes in histogram, array of code lengths
+// returns the size of the bitstream in bits
+static uint64_t coded_bits(uint64_t histogram[static ALPHABET],
+                           uint8_t lengths[static ALPHABET]) {
+  uint64_t bits = 0;
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    bits += histogram[i] * lengths[i];
+  }
+  return bits;
+}
+
+// takes in mapped infile, size of infile, number of threads, histogram
+// counts the mapping in place, one slice per thread for large files
+static void map_histogram(uint8_t *map, uint64_t size, uint32_t threads,
+                          uint64_t histogram[static ALPHABET]) {
+  threads = size / PARALLEL_SLICE < threads ? size / PARALLEL_SLICE : threads;
+  if (threads < 2 || !histogram_parallel(map, size, threads, histogram)) {
+    histogram_add(map, size, histogram);
+  }
+}
+
+// takes in mapped infile or NULL, infile descriptor, size of infile, number
+// of samples, histogram
+// estimates the histogram from samples reads of HISTOGRAM_BUFFER bytes evenly
+// spaced through infile, scaled up to its size, and gives every symbol a
+// count of at least one so that symbols the samples missed still have a code
+// returns the number of bytes sampled
+static uint64_t sample_histogram(uint8_t *map, int infile, uint64_t size,
+                                 uint32_t samples,
+                                 uint64_t histogram[static ALPHABET]) {
+  uint8_t read_buffer[HISTOGRAM_BUFFER];
+  uint64_t stride = size / samples;
+  uint64_t sampled = 0;
+  for (uint64_t i = 0; i < samples; i += 1) {
+    if (map) { // only the sampled pages are read in
+      histogram_add(map + i * stride, HISTOGRAM_BUFFER, histogram);
+      sampled += HISTOGRAM_BUFFER;
+    } else {
+      int bytes = pread_bytes(infile, read_buffer, HISTOGRAM_BUFFER,
+                              i * stride);
+      histogram_add(read_buffer, bytes > 0 ? bytes : 0, histogram);
+      sampled += bytes > 0 ? bytes : 0;
+    }
+  }
+  uint64_t scale = sampled ? size / sampled : 1;
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    histogram[i] = histogram[i] * scale + 1;
+  }
+  return sampled;
+}
+
+// takes in infile and outfile descriptors, stats of infile, whether to store
+// canonical code lengths, maximum code length or 0, number of threads for the
+// histogram, number of samples or 0, verbose flag
+// compresses infile as a single Huffman coded stream, from an estimated
+// histogram when sampling leaves most of infile unread
+// returns boolean if successful
+static bool encode_stream(int infile, int outfile, struct stat *infile_stats,
+                          bool c_case, uint32_t limit, uint32_t threads,
+                          uint32_t samples, bool v_case) {
+  uint32_t bytes = 0;
+
+  // scan a regular infile in place, and read anything else twice
+  uint64_t size = 0;
+  uint8_t *map = map_input(infile, &size);
+
+  // create histogram
+  stats_phase(PHASE_HISTOGRAM);
+  uint64_t hist[ALPHABET] = {0};
+  uint8_t read_buffer[HISTOGRAM_BUFFER] = {0};
+  uint32_t unique_symbols = 0;
+  uint64_t sampled = 0;
+  if (!c_case) { // the tree dump needs at least two leaves
+    hist[0] += 1;
+    hist[255] += 1;
+    unique_symbols = 2;
+  }
+  if (samples > 0 &&
+      (uint64_t)samples * HISTOGRAM_BUFFER < (uint64_t)infile_stats->st_size) {
+    sampled = sample_histogram(map, infile, infile_stats->st_size, samples,
+                               hist);
+    unique_symbols = ALPHABET;
+  } else if (map) {
+    map_histogram(map, size, threads, hist);
+    unique_symbols = 0;
+    for (uint32_t i = 0; i < ALPHABET; i += 1) {
+      unique_symbols += hist[i] > 0;
+    }
+  } else {
+    unique_symbols += create_histogram(infile, read_buffer, hist, bytes);
+  }
+
+  // construct Huffman Tree
+  stats_phase(PHASE_TREE);
+  Tree *huff_tree = build_tree(hist);
+  if (!huff_tree) {
+    fprintf(stderr, "Error: failed to build the Huffman tree\n");
+    unmap_input(map, size);
+    return false;
+  }
+
+  // canonical codes only need the code lengths of the tree
+  stats_phase(PHASE_CODES);
+  uint8_t lengths[ALPHABET] = {0};
+  PackedCode packed_table[ALPHABET] = {0};
+  uint32_t longest = c_case ? build_lengths(huff_tree, lengths) : 0;
+  uint64_t optimal_bits = coded_bits(hist, lengths);
+  if (c_case && limit > 0 && longest > limit) {
+    if (!limit_lengths(hist, limit, lengths)) {
+      fprintf(stderr, "Error: failed to limit code lengths\n");
+      tree_delete(&huff_tree);
+      unmap_input(map, size);
+      return false;
+    }
+    longest = 0; // raised past limit when there are more than 2^limit symbols
+    for (uint32_t i = 0; i < ALPHABET; i += 1) {
+      longest = lengths[i] > longest ? lengths[i] : longest;
+    }
+    if (longest > limit) {
+      fprintf(stderr,
+              "Warning: code length limit raised from %" PRIu32 " to %" PRIu32
+              " bits to code every symbol\n",
+              limit, longest);
+      limit = longest;
+    }
+  }
+  if (c_case && longest > MAX_PACKED_BITS) {
+    c_case = false; // too long to pack, keep the tree dump format
+  }
+  if (c_case) {
+    canonical_codes(lengths, packed_table);
+  }
+
+  // build code table and pack codes into integers for the bit accumulator
+  Code code_table[ALPHABET] = {0};
+  bool packed = true;
+  if (!c_case) {
+    build_codes(huff_tree, code_table);
+    for (uint32_t i = 0; i < ALPHABET; i += 1) {
+      packed_table[i] = code_pack(&code_table[i]);
+      if (packed_table[i].length > MAX_PACKED_BITS) {
+        packed = false;
       }
-      histogram[read_buffer[i]] += 1;
     }
   }
-  return unique_symbols;
+
+  // create header
+  stats_phase(PHASE_HEADER);
+  Header header;
+  header.permissions = infile_stats->st_mode;
+  header.file_size = infile_stats->st_size;
+  if (c_case) {
+    header.magic = MAGIC_VERSIONED;
+    header.version = VERSION_CANONICAL;
+    header.flags = 0;
+  } else {
+    header.magic = MAGIC;
+    header.tree_size = (unique_symbols * 3) - 1;
+  }
+  write_bytes(outfile, (uint8_t *)&header, sizeof(header));
+
+  // dump code lengths or tree to outfile
+  if (c_case) {
+    dump_lengths(outfile, lengths);
+  } else {
+    dump_tree(outfile, huff_tree);
+  }
+
+  // go back to beginning of infile
+  stats_phase(PHASE_CODING);
+  lseek(infile, 0, SEEK_SET);
+
+  // write codes to outfile, bit by bit only if a code is too long to pack,
+  // and price a sampled histogram against the real one for -v
+  BitWriter writer;
+  uint8_t write_buffer[BLOCK];
+  uint64_t counted[ALPHABET] = {0};
+  bool count = v_case && sampled > 0;
+  bit_writer_init(&writer, outfile, write_buffer, BLOCK);
+  if (packed) {
+    for (uint64_t i = 0; i < size; i += bytes) {
+      bytes = size - i < HISTOGRAM_BUFFER ? size - i : HISTOGRAM_BUFFER;
+      write_symbols(&writer, packed_table, map + i, bytes);
+      if (count) {
+        histogram_add(map + i, bytes, counted);
+      }
+    }
+    while (!map && (bytes = read_bytes(infile, read_buffer, BLOCK)) > 0) {
+      write_symbols(&writer, packed_table, read_buffer, bytes);
+      if (count) {
+        histogram_add(read_buffer, bytes, counted);
+      }
+    }
+  } else {
+    for (uint64_t i = 0; i < size; i += 1) {
+      write_code(&writer, &code_table[map[i]]);
+    }
+    if (count && map) {
+      histogram_add(map, size, counted);
+    }
+    while (!map && (bytes = read_bytes(infile, read_buffer, BLOCK)) > 0) {
+      for (uint32_t i = 0; i < bytes; i += 1) {
+        write_code(&writer, &code_table[read_buffer[i]]);
+      }
+      if (count) {
+        histogram_add(read_buffer, bytes, counted);
+      }
+    }
+  }
+  bit_writer_flush(&writer);
+  stats_phase(PHASE_OTHER);
+
+  if (count) {
+    uint8_t counted_lengths[ALPHABET];
+    uint64_t sampled_bits = 0;
+    for (uint32_t i = 0; i < ALPHABET; i += 1) {
+      sampled_bits += counted[i] * (c_case ? packed_table[i].length
+                                           : code_size(&code_table[i]));
+    }
+    optimal_lengths(counted, counted_lengths);
+    uint64_t counted_bits = coded_bits(counted, counted_lengths);
+    fprintf(stderr,
+            "Sampled histogram: read %" PRIu64 " of %" PRIu64 " bytes "
+            "(%.2f%%) in the first pass, %.4f%% larger bitstream than a "
+            "full count\n",
+            sampled, (uint64_t)infile_stats->st_size,
+            100.0 * sampled / infile_stats->st_size,
+            counted_bits ? 100.0 * (sampled_bits - counted_bits) / counted_bits
+                         : 0.0);
+  }
+
+  if (v_case && limit > 0) {
+    uint64_t limited_bits = coded_bits(hist, lengths);
+    fprintf(stderr,
+            "Code length limit: %" PRIu32 " bits, %.4f%% larger "
+            "bitstream than unlimited\n",
+            limit,
+            optimal_bits ? 100.0 * (limited_bits - optimal_bits) / optimal_bits
+                         : 0.0);
+  }
+  tree_delete(&huff_tree);
+  unmap_input(map, size);
+  return true;
+}
+
+// a block of infile and its compressed form, coded on the thread pool
+typedef struct {
+  Task task;
+  uint8_t *in;
+  uint8_t *out;
+  uint32_t raw_size;
+  uint32_t size;
+  uint64_t bits;
+  uint32_t limit;
+  uint32_t streams;
+  bool context;
+  bool checksum;
+  uint32_t crc; // CRC32C of the block
+} Job;
+
+// takes in Job
+// compresses the block of the job
+static void compress_job(void *arg) {
+  Job *j = (Job *)arg;
+  j->size = encode_block(j->in, j->raw_size, j->out, j->limit, j->streams,
+                         j->context, &j->bits);
+  if (j->size > 0 && j->checksum) { // while the block is still in cache
+    j->crc = crc32c(0, j->in, j->raw_size);
+    memcpy(j->out + j->size, &j->crc, sizeof(j->crc));
+    j->size += sizeof(j->crc);
+  }
+}
+
+// growable array of the index entries of the blocks written so far
+typedef struct {
+  IndexEntry *entries;
+  uint32_t blocks;
+  uint32_t capacity;
+  uint64_t offset;   // file offset of the next block
+  uint32_t checksum; // CRC32C of the checksums of the blocks so far
+} Index;
+
+// takes in Ring, finished Job, Index
+// queues the block header and compressed block, which follows it in the same
+// buffer, to be written, records them in the index and gives the job a fresh
+// buffer
+// returns boolean if the block compressed and the writes so far succeeded
+static bool write_job(Ring *ring, Job *j, Index *index) {
+  if (j->size == 0) {
+    return false;
+  }
+  if (index->blocks == index->capacity) {
+    uint32_t capacity = index->capacity ? 2 * index->capacity : 64;
+    IndexEntry *entries = (IndexEntry *)realloc(
+        index->entries, capacity * sizeof(IndexEntry));
+    if (!entries) {
+      return false;
+    }
+    index->entries = entries;
+    index->capacity = capacity;
+  }
+  IndexEntry entry = {index->offset, j->raw_size, j->size, j->bits};
+  index->entries[index->blocks] = entry;
+  index->blocks += 1;
+  index->offset += sizeof(BlockHeader) + j->size;
+  if (j->checksum) {
+    index->checksum =
+        crc32c(index->checksum, (uint8_t *)&j->crc, sizeof(j->crc));
+  }
+  BlockHeader block = {j->raw_size, j->size};
+  memcpy(j->out - sizeof(block), &block, sizeof(block));
+  bool ok = ring_write(ring, j->out - sizeof(block), sizeof(block) + j->size);
+  uint8_t *buf = ring_buffer(ring);
+  j->out = buf ? buf + sizeof(block) : NULL;
+  return ok && buf;
+}
+
+// takes in infile and outfile descriptors, stats of infile, block size,
+// number of threads, maximum code length or 0, number of bitstreams per block,
+// whether to code blocks by context, whether to checksum them
+// compresses infile in independent blocks, each with its own code, read ahead,
+// coded in parallel and written in order behind the coder threads with at
+// most three blocks per thread in memory, then an index of the blocks for
+// parallel decompression, streaming a pipe of unknown size through to an
+// empty block that ends it
+// returns boolean if successful
+static bool encode_blocks(int infile, int outfile, struct stat *infile_stats,
+                          uint32_t block_size, uint32_t threads,
+                          uint32_t limit, uint32_t streams, bool context,
+                          bool checksum) {
+  stats_phase(PHASE_HEADER);
+  Header header;
+  header.magic = MAGIC_VERSIONED;
+  header.version = VERSION_BLOCKS;
+  header.flags = FLAG_INDEX | (streams > 1 ? FLAG_STREAMS : 0) |
+                 (context ? FLAG_CONTEXT : 0) |
+                 (checksum ? FLAG_CHECKSUM : 0);
+  header.permissions = infile_stats->st_mode;
+  header.file_size = infile_stats->st_size;
+  bool streamed = !S_ISREG(infile_stats->st_mode);
+  if (streamed) {
+    header.flags |= FLAG_STREAMED;
+    header.file_size = 0;
+  }
+  write_bytes(outfile, (uint8_t *)&header, sizeof(header));
+
+  // blocks of a regular infile are coded straight from a mapping of it
+  uint64_t size = 0;
+  uint64_t offset = 0;
+  uint8_t *map = map_input(infile, &size);
+
+  // the ring reads a file that is not mapped and writes every block; past
+  // the buffer each slot holds, it keeps one of each kind per thread moving,
+  // so blocks are read ahead and written behind while the slots code
+  uint32_t slots = 2 * threads;
+  Pool *pool = pool_create(threads);
+  Job *jobs = (Job *)calloc(slots, sizeof(Job));
+  Ring *ring = ring_create(map ? -1 : infile, outfile, block_size,
+                           sizeof(BlockHeader) + block_bound(block_size),
+                           slots, threads);
+  Index index = {NULL, 0, 0, sizeof(header), 0};
+  bool ok = pool && jobs && ring;
+  for (uint32_t i = 0; ok && i < slots; i += 1) {
+    jobs[i].task.run = compress_job;
+    jobs[i].task.arg = &jobs[i];
+    jobs[i].limit = limit;
+    jobs[i].streams = streams;
+    jobs[i].context = context;
+    jobs[i].checksum = checksum;
+    jobs[i].out = ring_buffer(ring) + sizeof(BlockHeader);
+  }
+
+  // time spent waiting on the coder threads counts as coding
+  stats_phase(PHASE_CODING);
+  uint64_t submitted = 0;
+  uint64_t written = 0;
+  while (ok) {
+    if (submitted - written == slots) { // reuse the oldest slot
+      Job *oldest = &jobs[written % slots];
+      pool_wait(pool, &oldest->task);
+      ok = write_job(ring, oldest, &index);
+      if (!map) {
+        ring_release(ring);
+      }
+      written += 1;
+      if (!ok) {
+        break;
+      }
+    }
+    Job *j = &jobs[submitted % slots];
+    if (map) {
+      j->in = map + offset;
+      j->raw_size = size - offset < block_size ? size - offset : block_size;
+      offset += j->raw_size;
+    } else {
+      int64_t bytes = ring_read(ring, &j->in);
+      ok = bytes >= 0;
+      j->raw_size = bytes > 0 ? bytes : 0;
+    }
+    if (!ok || j->raw_size == 0) {
+      break;
+    }
+    pool_submit(pool, &j->task);
+    submitted += 1;
+  }
+  for (; written < submitted; written += 1) { // blocks still in flight
+    Job *j = &jobs[written % slots];
+    pool_wait(pool, &j->task);
+    ok = ok && write_job(ring, j, &index);
+  }
+  ok = ring && ring_finish(ring) && ok;
+
+  // end a stream of unknown size with an empty block
+  if (ok && streamed) {
+    BlockHeader end = {0, 0};
+    write_bytes(outfile, (uint8_t *)&end, sizeof(end));
+    index.offset += sizeof(end);
+  }
+
+  // end the blocks with the checksum of their checksums
+  if (ok && checksum) {
+    write_bytes(outfile, (uint8_t *)&index.checksum, sizeof(index.checksum));
+    index.offset += sizeof(index.checksum);
+  }
+
+  // write the index and the footer locating it
+  stats_phase(PHASE_HEADER);
+  if (ok) {
+    IndexFooter footer = {index.offset, index.blocks, INDEX_MAGIC};
+    write_bytes(outfile, (uint8_t *)index.entries,
+                index.blocks * sizeof(IndexEntry));
+    write_bytes(outfile, (uint8_t *)&footer, sizeof(footer));
+  }
+  free(index.entries);
+  stats_phase(PHASE_OTHER);
+
+  pool_delete(&pool);
+  ring_delete(&ring);
+  free(jobs);
+  unmap_input(map, size);
+  return ok;
+}
+
+// takes in infile and outfile descriptors, stats of infile
+// compresses infile in one pass with a code that adapts to the symbols seen
+// so far, writing each read as a chunk that decodes as soon as it arrives,
+// through to an empty chunk that ends the stream
+// returns boolean if successful
+static bool encode_adaptive(int infile, int outfile,
+                            struct stat *infile_stats) {
+  stats_phase(PHASE_HEADER);
+  Header header;
+  header.magic = MAGIC_VERSIONED;
+  header.version = VERSION_ADAPTIVE;
+  header.flags = FLAG_STREAMED;
+  header.permissions = infile_stats->st_mode;
+  header.file_size = 0;
+  write_bytes(outfile, (uint8_t *)&header, sizeof(header));
+
+  stats_phase(PHASE_CODING);
+  Model *m = model_create();
+  uint8_t *in = (uint8_t *)malloc(ADAPT_CHUNK);
+  uint8_t *out = (uint8_t *)malloc(adaptive_bound(ADAPT_CHUNK));
+  bool ok = m && in && out;
+  int bytes = 0;
+  while (ok && (bytes = read_some(infile, in, ADAPT_CHUNK)) > 0) {
+    BlockHeader chunk = {bytes, adaptive_encode(m, in, bytes, out)};
+    ok = chunk.size > 0;
+    if (ok) {
+      write_bytes(outfile, (uint8_t *)&chunk, sizeof(chunk));
+      write_bytes(outfile, out, chunk.size);
+    }
+  }
+  if (ok) {
+    BlockHeader end = {0, 0};
+    write_bytes(outfile, (uint8_t *)&end, sizeof(end));
+  }
+  stats_phase(PHASE_OTHER);
+  model_delete(&m);
+  free(in);
+  free(out);
+  return ok;
+}
+
+// takes in infile and outfile descriptors, stats of infile, registry, ID of
+// the trained table
+// compresses infile in one pass with a table the decoder already has, storing
+// only its ID, streaming a pipe in chunks through to an empty chunk
+// returns boolean if successful
+static bool encode_trained(int infile, int outfile, struct stat *infile_stats,
+                           Registry *tables, uint32_t id) {
+  stats_phase(PHASE_HEADER);
+  PackedCode *codes = registry_codes(tables, id);
+  Header header;
+  header.magic = MAGIC_VERSIONED;
+  header.version = VERSION_TRAINED;
+  header.flags = 0;
+  header.permissions = infile_stats->st_mode;
+  header.file_size = infile_stats->st_size;
+  bool streamed = !S_ISREG(infile_stats->st_mode);
+  if (streamed) {
+    header.flags |= FLAG_STREAMED;
+    header.file_size = 0;
+  }
+  write_bytes(outfile, (uint8_t *)&header, sizeof(header));
+  write_bytes(outfile, (uint8_t *)&id, sizeof(id));
+
+  stats_phase(PHASE_CODING);
+  uint64_t size = 0;
+  uint8_t *map = streamed ? NULL : map_input(infile, &size);
+  uint8_t *in = (uint8_t *)malloc(ADAPT_CHUNK);
+  uint8_t *out = (uint8_t *)malloc(registry_bound(ADAPT_CHUNK));
+  bool ok = in && out;
+  BitWriter writer;
+  int bytes = 0;
+  if (ok && !streamed) {
+    bit_writer_init(&writer, outfile, out, ADAPT_CHUNK);
+    for (uint64_t i = 0; i < size; i += bytes) {
+      bytes = size - i < ADAPT_CHUNK ? size - i : ADAPT_CHUNK;
+      write_symbols(&writer, codes, map + i, bytes);
+    }
+    while (!map && (bytes = read_bytes(infile, in, ADAPT_CHUNK)) > 0) {
+      write_symbols(&writer, codes, in, bytes);
+    }
+    bit_writer_flush(&writer);
+  }
+  while (ok && streamed && (bytes = read_some(infile, in, ADAPT_CHUNK)) > 0) {
+    bit_writer_init(&writer, -1, out, registry_bound(ADAPT_CHUNK));
+    write_symbols(&writer, codes, in, bytes);
+    BlockHeader chunk = {bytes, bit_writer_flush(&writer)};
+    write_bytes(outfile, (uint8_t *)&chunk, sizeof(chunk));
+    write_bytes(outfile, out, chunk.size);
+  }
+  if (ok && streamed) {
+    BlockHeader end = {0, 0};
+    write_bytes(outfile, (uint8_t *)&end, sizeof(end));
+  }
+  stats_phase(PHASE_OTHER);
+  unmap_input(map, size);
+  free(in);
+  free(out);
+  return ok;
+}
+
+// takes in sample files, infile descriptor counted when there are none, path
+// of the table file
+// trains a table on the symbols of the samples and writes it to the table
+// file, printing its ID
+// returns boolean if successful
+static bool train_table(FileList *samples, int infile, const char *path) {
+  uint64_t hist[ALPHABET] = {0};
+  uint8_t read_buffer[HISTOGRAM_BUFFER];
+  for (uint32_t i = 0; i < samples->count; i += 1) {
+    int sample = open(samples->paths[i], O_RDONLY);
+    if (sample == -1) {
+      fprintf(stderr, "Error: failed to open %s\n", samples->paths[i]);
+      return false;
+    }
+    create_histogram(sample, read_buffer, hist, 0);
+    close(sample);
+  }
+  if (samples->count == 0) {
+    create_histogram(infile, read_buffer, hist, 0);
+  }
+  uint8_t lengths[ALPHABET];
+  uint32_t id = 0;
+  if (!train_lengths(hist, lengths)) {
+    fprintf(stderr, "Error: failed to train a table\n");
+    return false;
+  }
+  if (!registry_save(lengths, path, &id)) {
+    fprintf(stderr, "Error: failed to write table %s\n", path);
+    return false;
+  }
+  printf("%08" PRIx32 "\n", id);
+  return true;
+}
+
+// takes in size argument, with an optional K or M suffix
+// returns size in bytes, 0 if invalid
+static uint32_t parse_size(char *arg) {
+  char *end = NULL;
+  uint64_t size = strtoull(arg, &end, 10);
+  if (*end == 'K' || *end == 'k') {
+    size <<= 10;
+    end += 1;
+  } else if (*end == 'M' || *end == 'm') {
+    size <<= 20;
+    end += 1;
+  }
+  if (*end != '\0' || size < BLOCK || size > MAX_BLOCK_SIZE) {
+    return 0;
+  }
+  return size;
+}
+
+// takes in infile and outfile descriptors, Settings
+// sets the permissions of outfile to those of infile and compresses infile
+// adaptively, in independent blocks or as a single stream
+// returns boolean if successful
+static bool encode_file(int infile, int outfile, void *arg) {
+  Settings *s = (Settings *)arg;
+  struct stat infile_stats;
+  if (fstat(infile, &infile_stats) == -1) {
+    return false;
+  }
+  fchmod(outfile, infile_stats.st_mode);
+
+  // a single stream takes two passes, so a pipe is streamed in blocks
+  if (s->samples > 0 && !s->tables && !s->a_case && !s->b_case &&
+      !S_ISREG(infile_stats.st_mode)) {
+    fprintf(stderr, "Error: -e only samples a regular file, not a pipe\n");
+    return false;
+  }
+  if (s->tables) {
+    return encode_trained(infile, outfile, &infile_stats, s->tables, s->table);
+  } else if (s->a_case) {
+    return encode_adaptive(infile, outfile, &infile_stats);
+  } else if (s->b_case || !S_ISREG(infile_stats.st_mode)) {
+    return encode_blocks(infile, outfile, &infile_stats, s->block_size,
+                         s->threads, s->limit, s->streams, s->x_case,
+                         s->k_case);
+  }
+  return encode_stream(infile, outfile, &infile_stats, s->c_case, s->limit,
+                       s->cpus, s->samples, s->v_case);
 }
 
 // main function to encode infile and write to outfile
 int main(int argc, char **argv) {
-  static uint32_t bytes = 0;
-  char *infile;
-  char *outfile;
-  int temp_file = 0;
-  bool v_case = false;
+  char *infile = NULL;
+  char *outfile = NULL;
+  uint32_t cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  Settings s = {false, false, false, false, false, false, 0, 1,
+                cpus < MAX_THREADS ? cpus : MAX_THREADS, 1, BLOCK_SIZE, 0,
+                NULL, 0};
+  char *table = NULL;
+  char *trained = NULL;
+  bool j_case = false;
+  bool json = false;
   bool i_case = false;
   bool o_case = false;
+  FileList batch = {NULL, 0, 0};
+  bool ok = true;
   int32_t opt = 0;
   while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
     switch (opt) {
@@ -68,7 +760,78 @@ int main(int argc, char **argv) {
       return 1;
       break;
     case 'v':
-      v_case = true;
+      s.v_case = true;
+      break;
+    case 'J':
+      s.v_case = true;
+      json = true;
+      break;
+    case 'c':
+      s.c_case = true;
+      break;
+    case 'a':
+      s.a_case = true;
+      break;
+    case 'x':
+      s.x_case = true;
+      s.b_case = true;
+      break;
+    case 'k':
+      s.k_case = true;
+      s.b_case = true;
+      break;
+    case 'l':
+      s.limit = strtoul(optarg, NULL, 10);
+      if (s.limit == 0 || s.limit > MAX_PACKED_BITS) {
+        fprintf(stderr, "Error: code length limit must be 1 to %d bits\n",
+                MAX_PACKED_BITS);
+        return 1;
+      }
+      s.c_case = true;
+      break;
+    case 'j':
+      s.threads = strtoul(optarg, NULL, 10);
+      if (s.threads == 0 || s.threads > MAX_THREADS) {
+        fprintf(stderr, "Error: thread count must be 1 to %d\n", MAX_THREADS);
+        return 1;
+      }
+      j_case = true;
+      break;
+    case 'b':
+      s.block_size = parse_size(optarg);
+      if (s.block_size == 0) {
+        fprintf(stderr, "Error: block size must be %d to %d bytes\n", BLOCK,
+                MAX_BLOCK_SIZE);
+        return 1;
+      }
+      s.b_case = true;
+      break;
+    case 's':
+      s.streams = strtoul(optarg, NULL, 10);
+      if (s.streams == 0 || s.streams > MAX_STREAMS) {
+        fprintf(stderr, "Error: stream count must be 1 to %d\n", MAX_STREAMS);
+        return 1;
+      }
+      s.b_case = true;
+      break;
+    case 'e':
+      s.samples = strtoul(optarg, NULL, 10);
+      if (s.samples == 0) {
+        fprintf(stderr, "Error: sample count must be at least 1\n");
+        return 1;
+      }
+      break;
+    case 'd':
+      table = optarg;
+      break;
+    case 'g':
+      trained = optarg;
+      break;
+    case 'm':
+      ok = ok && list_manifest(&batch, optarg);
+      break;
+    case 'r':
+      ok = ok && list_walk(&batch, optarg, false);
       break;
     case 'i':
       infile = optarg;
@@ -84,6 +847,72 @@ int main(int argc, char **argv) {
       break;
     }
   }
+  for (int i = optind; ok && i < argc; i += 1) {
+    ok = list_add(&batch, argv[i]);
+  }
+  if (!ok) {
+    fprintf(stderr, "Error: failed to list the files to compress\n");
+    list_clear(&batch);
+    return 1;
+  }
+
+  // only a single stream has a first pass for -e to sample; -j on one file
+  // codes blocks, but on a batch it only sets the files at once
+  if (s.samples > 0 &&
+      (s.a_case || s.b_case || table || (j_case && batch.count == 0))) {
+    fprintf(stderr, "Error: -e only samples a single stream, not with -a, "
+                    "-b, -d or -j\n");
+    list_clear(&batch);
+    return 1;
+  }
+
+  // train a table on the input instead of compressing it
+  if (trained) {
+    if (i_case) {
+      fd_in = open(infile, O_RDONLY);
+      if (fd_in == -1) {
+        fprintf(stderr, "Error: failed to open infile\n");
+        list_clear(&batch);
+        return 1;
+      }
+    }
+    ok = train_table(&batch, fd_in, trained);
+    list_clear(&batch);
+    if (i_case) {
+      close(fd_in);
+    }
+    return ok ? 0 : 1;
+  }
+
+  // load the trained table, shared read only by every file of a batch
+  if (table) {
+    s.tables = registry_create();
+    if (!s.tables || !registry_load(s.tables, table, &s.table)) {
+      fprintf(stderr, "Error: failed to load table %s\n", table);
+      registry_delete(&s.tables);
+      list_clear(&batch);
+      return 1;
+    }
+  }
+
+  // compress a batch of files at once, one file per thread
+  if (batch.count > 0 && (i_case || o_case)) {
+    fprintf(stderr, "Error: -i and -o do not apply to a batch of files\n");
+    list_clear(&batch);
+    registry_delete(&s.tables);
+    return 1;
+  }
+  if (batch.count > 0) {
+    uint32_t workers = s.threads;
+    s.threads = 1;
+    s.cpus = 1;
+    s.v_case = false;
+    ok = batch_run(&batch, workers, false, false, encode_file, &s);
+    list_clear(&batch);
+    registry_delete(&s.tables);
+    return ok ? 0 : 1;
+  }
+  s.b_case = s.b_case || j_case;
 
   // open infile
   if (i_case) {
@@ -92,18 +921,8 @@ int main(int argc, char **argv) {
       fprintf(stderr, "Error: failed to open infile\n");
       return 1;
     }
-  } else { // reading from stdin
-    uint8_t buffer[BLOCK] = {0};
-    temp_file = open("/tmp/temp_file", O_CREAT | O_RDWR | O_TRUNC, 0600);
-    while ((bytes = read_bytes(fd_in, buffer, BLOCK)) > 0) {
-      write_bytes(temp_file, buffer, BLOCK);
-    }
-    fd_in = temp_file;
   }
 
-  // go back to beginning of infile
-  lseek(fd_in, 0, SEEK_SET);
-
   // open outfile
   if (o_case) {
     fd_out = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0600);
@@ -113,56 +932,32 @@ int main(int argc, char **argv) {
     }
   }
 
-  // create histogram
-  uint64_t hist[ALPHABET] = {0};
-  uint8_t read_buffer[BLOCK] = {0};
-  uint32_t unique_symbols = 2;
-  bytes = 0;
-  hist[0] += 1;
-  hist[255] += 1;
-  unique_symbols += create_histogram(fd_in, read_buffer, hist, bytes);
-
-  // get stats for infile and set permissions of outfile to the same as infile
-  struct stat infile_stats;
-  fstat(fd_in, &infile_stats);
-  fchmod(fd_out, infile_stats.st_mode);
-
-  // construct Huffman Tree
-  Node *huff_tree = build_tree(hist);
-
-  // build code table
-  Code code_table[ALPHABET] = {0};
-  build_codes(huff_tree, code_table);
-
-  // create header
-  Header header;
-  header.magic = MAGIC;
-  header.permissions = infile_stats.st_mode;
-  header.tree_size = (unique_symbols * 3) - 1;
-  header.file_size = infile_stats.st_size;
-  write_bytes(fd_out, (uint8_t *)&header, sizeof(header));
-
-  // dump tree to outfile
-  dump_tree(fd_out, huff_tree);
-
-  // go back to beginning of infile
-  lseek(fd_in, 0, SEEK_SET);
-
-  // write codes to outfile
-  while ((bytes = read_bytes(fd_in, read_buffer, BLOCK)) > 0) {
-    for (uint32_t i = 0; i < bytes; i += 1) {
-      write_code(fd_out, &code_table[read_buffer[i]]);
-    }
+  if (s.v_case) {
+    stats_start();
+  }
+  ok = encode_file(fd_in, fd_out, &s);
+  stats_stop();
+  if (!ok) {
+    fprintf(stderr, "Error: failed to compress infile\n");
   }
-  flush_codes(fd_out);
 
   // print statistics
-  if (v_case) {
-    fprintf(stderr, "Uncompressed file size: %" PRIu64 " bytes\n",
-            infile_stats.st_size);
-    fprintf(stderr, "Compressed file size: %" PRIu64 " bytes\n", bytes_written);
-    fprintf(stderr, "Space saving: %.2f%%\n",
-            (1 - ((double)bytes_written / infile_stats.st_size)) * 100);
+  if (s.v_case) {
+    struct stat infile_stats;
+    fstat(fd_in, &infile_stats);
+    uint64_t size = S_ISREG(infile_stats.st_mode)
+                        ? (uint64_t)infile_stats.st_size
+                        : bytes_read;
+    if (json) {
+      stats_print(size, bytes_written, true);
+    } else {
+      fprintf(stderr, "Uncompressed file size: %" PRIu64 " bytes\n", size);
+      fprintf(stderr, "Compressed file size: %" PRIu64 " bytes\n",
+              bytes_written);
+      fprintf(stderr, "Space saving: %.2f%%\n",
+              (1 - ((double)bytes_written / size)) * 100);
+      stats_print(size, bytes_written, false);
+    }
   }
 
   // cleanup time
@@ -172,10 +967,7 @@ int main(int argc, char **argv) {
   if (o_case) {
     close(fd_out);
   }
-  if (temp_file) {
-    unlink("tmp/temp_file");
-  }
-  delete_tree(&huff_tree);
+  registry_delete(&s.tables);
 
-  return 0;
+  return ok ? 0 : 1;
 }
@@ -5,6 +5,30 @@
 typedef struct {
   uint32_t magic;
   uint16_t permissions;
-  uint16_t tree_size;
+  union {
+    uint16_t tree_size; // MAGIC: size of the tree dump
+    struct {
+      uint8_t version; // MAGIC_VERSIONED: format of the rest of the file
+      uint8_t flags;
+    };
+  };
   uint64_t file_size;
 } Header;
+
+typedef struct {
+  uint32_t raw_size; // bytes in the block before compression
+  uint32_t size;     // bytes of code lengths and bitstream that follow
+} BlockHeader;
+
+typedef struct {
+  uint64_t offset;   // file offset of the BlockHeader
+  uint32_t raw_size; // bytes in the block before compression
+  uint32_t size;     // bytes of code lengths and bitstream
+  uint64_t bits;     // bits in the bitstream
+} IndexEntry;
+
+typedef struct {
+  uint64_t offset; // file offset of the first IndexEntry
+  uint32_t blocks; // number of IndexEntry
+  uint32_t magic;
+} IndexFooter;
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "defines.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+void histogram_add(uint8_t *buf, uint64_t nbytes,
+                   uint64_t hist[static ALPHABET]);
+
+bool histogram_parallel(uint8_t *buf, uint64_t nbytes, uint32_t threads,
+                        uint64_t hist[static ALPHABET]);
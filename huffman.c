@@ -1,107 +1,492 @@
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "huffman.h"
 #include "io.h"
-#include "pq.h"
-#include "stack.h"
 
-// takes in histogram of uint64_t's of size ALPHABET
-// constructs Huffman tree
-// returns root node
-Node *build_tree(uint64_t hist[static ALPHABET]) {
-  PriorityQueue *pq = pq_create(ALPHABET);
-  for (uint32_t i = 0; i < ALPHABET; i += 1) { // adding nodes to pq
+// takes in histogram of uint64_t's of size ALPHABET, array for the symbols
+// sorts the present symbols by frequency with an LSD radix sort on the bytes
+// of the frequencies, skipping the high bytes that are 0 in every one, ties
+// kept in symbol order
+// returns the number of present symbols
+static uint32_t sort_symbols(uint64_t hist[static ALPHABET],
+                             uint16_t sorted[static ALPHABET]) {
+  uint16_t buf[ALPHABET];
+  uint16_t *src = sorted;
+  uint16_t *dst = buf;
+  uint64_t any = 0;
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
     if (hist[i] > 0) {
-      Node *n = node_create(i, hist[i]);
-      enqueue(pq, n);
+      sorted[n] = i;
+      n += 1;
+      any |= hist[i];
+    }
+  }
+  for (uint32_t shift = 0; shift < 64 && (any >> shift) != 0; shift += 8) {
+    uint32_t count[ALPHABET + 1] = {0};
+    for (uint32_t i = 0; i < n; i += 1) {
+      count[((hist[src[i]] >> shift) & 0xFF) + 1] += 1;
     }
+    for (uint32_t d = 0; d < ALPHABET; d += 1) {
+      count[d + 1] += count[d];
+    }
+    for (uint32_t i = 0; i < n; i += 1) {
+      dst[count[(hist[src[i]] >> shift) & 0xFF]++] = src[i];
+    }
+    uint16_t *swap = src;
+    src = dst;
+    dst = swap;
   }
-  while (pq_size(pq) > 1) { // build tree from pq
-    Node *left = NULL;
-    Node *right = NULL;
-    dequeue(pq, &left);
-    dequeue(pq, &right);
-    Node *parent = node_join(left, right);
-    enqueue(pq, parent);
+  if (src != sorted) {
+    memcpy(sorted, src, n * sizeof(uint16_t));
   }
-  Node *root = NULL;
-  dequeue(pq, &root);
-  pq_delete(&pq);
-  return root;
+  return n;
 }
 
-// takes in Node root and Code table of size ALPHABET
-// builds code for each symbol in Huffman tree and copies it to code table
-void build_codes(Node *root, Code table[static ALPHABET]) {
-  static Code c = {0};
-  if (!root) {
-    return;
+// takes in histogram of uint64_t's of size ALPHABET
+// constructs Huffman tree in a single arena of nodes in linear time: the
+// leaves are sorted once, and since parents are made in order of weight, the
+// two lightest subtrees are always at the heads of the leaves and parents
+// returns tree, with no root for an empty histogram, NULL on failure
+Tree *build_tree(uint64_t hist[static ALPHABET]) {
+  uint16_t sorted[ALPHABET];
+  uint32_t n = sort_symbols(hist, sorted);
+  Tree *t = tree_create();
+  if (!t) {
+    return NULL;
+  }
+  for (uint32_t i = 0; i < n; i += 1) { // leaves are nodes 0 to n - 1
+    node_create(t, sorted[i], hist[sorted[i]]);
+  }
+  uint32_t leaf = 0;
+  uint32_t parent = n;
+  while ((n - leaf) + (t->size - parent) > 1) { // join the two lightest
+    Node *pair[2];
+    for (uint32_t k = 0; k < 2; k += 1) {
+      if (leaf < n && (parent == t->size || t->nodes[leaf].frequency <=
+                                                t->nodes[parent].frequency)) {
+        pair[k] = &t->nodes[leaf];
+        leaf += 1;
+      } else {
+        pair[k] = &t->nodes[parent];
+        parent += 1;
+      }
+    }
+    node_join(t, pair[0], pair[1]);
   }
-  if (!root->left && !root->right) { // leaf node
-    table[root->symbol] = c;
+  t->root = n > 0 ? t->size - 1 : NO_NODE;
+  return t;
+}
+
+// takes in Tree t, index of a node, Code c of the path to the node, Code
+// table of size ALPHABET
+// builds code for each symbol under the node and copies it to code table
+static void walk_codes(Tree *t, uint16_t i, Code *c,
+                       Code table[static ALPHABET]) {
+  Node *n = &t->nodes[i];
+  if (n->left == NO_NODE) { // leaf node
+    table[n->symbol] = *c;
   } else { // internal node
     uint8_t pop = 0;
-    code_push_bit(&c, 0);
-    build_codes(root->left, table);
-    code_pop_bit(&c, &pop);
-    code_push_bit(&c, 1);
-    build_codes(root->right, table);
-    code_pop_bit(&c, &pop);
+    code_push_bit(c, 0);
+    walk_codes(t, n->left, c, table);
+    code_pop_bit(c, &pop);
+    code_push_bit(c, 1);
+    walk_codes(t, n->right, c, table);
+    code_pop_bit(c, &pop);
   }
 }
 
-// takes in outfile file descriptor, pointer to a Node
-// writes Huffman tree to outfile using a postorder traversal,
-// L representing a leaf and I representing an interior node
-void dump_tree(int outfile, Node *root) {
-  if (root) {
-    dump_tree(outfile, root->left);
-    dump_tree(outfile, root->right);
-    if (!root->left && !root->right) { // leaf node
-      uint8_t buff[1] = {'L'};
-      write_bytes(outfile, buff, 1);
-      uint8_t symbol = {root->symbol};
-      write_bytes(outfile, &symbol, 1);
-    } else { // interior node
-      uint8_t symbol = {'I'};
-      write_bytes(outfile, &symbol, 1);
-    }
+// takes in Tree t and Code table of size ALPHABET
+// builds code for each symbol in Huffman tree and copies it to code table
+void build_codes(Tree *t, Code table[static ALPHABET]) {
+  Code c = code_init();
+  if (t && t->root != NO_NODE) {
+    walk_codes(t, t->root, &c, table);
+  }
+}
+
+// takes in Tree t, index of a node, buffer, number of bytes in buffer
+// stores the subtree of the node in buffer using a postorder traversal,
+// L and the symbol representing a leaf and I representing an interior node
+// returns the number of bytes in buffer
+static uint32_t dump_node(Tree *t, uint16_t i, uint8_t *buf, uint32_t size) {
+  Node *n = &t->nodes[i];
+  if (n->left == NO_NODE) { // leaf node
+    buf[size] = 'L';
+    buf[size + 1] = n->symbol;
+    return size + 2;
+  }
+  size = dump_node(t, n->left, buf, size);
+  size = dump_node(t, n->right, buf, size);
+  buf[size] = 'I'; // interior node
+  return size + 1;
+}
+
+// takes in outfile file descriptor, Tree t
+// writes Huffman tree to outfile in a single write, using a postorder
+// traversal
+void dump_tree(int outfile, Tree *t) {
+  uint8_t buf[MAX_TREE_SIZE];
+  if (t && t->root != NO_NODE) {
+    write_bytes(outfile, buf, dump_node(t, t->root, buf, 0));
   }
 }
 
 // takes in int nbytes, tree dump of nbytes size
-// reconstruct Huffman tree using a stack, given the tree dump
-// returns root node
-Node *rebuild_tree(uint16_t nbytes, uint8_t tree[static nbytes]) {
-  Stack *s = stack_create(nbytes);
-  for (uint32_t i = 0; i < nbytes; i += 1) {
-    if (tree[i] == 'L') { // leaf nodes
-      Node *n = node_create(tree[i + 1], 1);
-      stack_push(s, n);
-      i += 1;                    // skip symbol after L
-    } else if (tree[i] == 'I') { // interior nodes
-      Node *left = NULL;
-      Node *right = NULL;
-      stack_pop(s, &right);
-      stack_pop(s, &left);
-      Node *parent = node_join(left, right);
-      stack_push(s, parent);
-    }
-  }
-  Node *root = NULL;
-  stack_pop(s, &root);
-  stack_delete(&s);
-  return root;
-}
-
-// takes in Node
-// deconstructs Huffman tree using a postorder traversal
-void delete_tree(Node **root) {
-  if (*root) {
-    delete_tree(&(*root)->left);
-    delete_tree(&(*root)->right);
-    node_delete(root);
+// reconstruct Huffman tree in a single arena using a stack of node indexes,
+// given the tree dump
+// returns tree, NULL if the dump is not a valid tree
+Tree *rebuild_tree(uint16_t nbytes, uint8_t tree[static nbytes]) {
+  uint16_t stack[MAX_NODES];
+  uint32_t top = 0;
+  Tree *t = tree_create();
+  bool ok = t != NULL;
+  for (uint32_t i = 0; ok && i < nbytes; i += 1) {
+    Node *n = NULL;
+    if (tree[i] == 'L' && i + 1 < nbytes) { // leaf nodes
+      n = node_create(t, tree[i + 1], 1);
+      i += 1;                             // skip symbol after L
+    } else if (tree[i] == 'I' && top >= 2) { // interior nodes
+      top -= 2;
+      n = node_join(t, &t->nodes[stack[top]], &t->nodes[stack[top + 1]]);
+    }
+    ok = n != NULL; // full arena, or a node without its operands
+    if (ok) {
+      stack[top] = n - t->nodes;
+      top += 1;
+    }
+  }
+  if (!ok || top != 1) {
+    tree_delete(&t);
+    return NULL;
+  }
+  t->root = stack[0];
+  return t;
+}
+
+// takes in Tree t, index of a node, depth of the node, array of code lengths
+// records the depth of each leaf below the node as its code length
+static void tree_lengths(Tree *t, uint16_t i, uint32_t depth,
+                         uint8_t lengths[static ALPHABET]) {
+  Node *n = &t->nodes[i];
+  if (n->left == NO_NODE) { // leaf node
+    lengths[n->symbol] = depth;
+  } else { // internal node
+    tree_lengths(t, n->left, depth + 1, lengths);
+    tree_lengths(t, n->right, depth + 1, lengths);
+  }
+}
+
+// takes in Tree t, array of code lengths of size ALPHABET
+// computes the code length of each symbol in the Huffman tree, 0 for absent
+// symbols, and 1 for the symbol of a single leaf tree
+// returns the longest code length
+uint32_t build_lengths(Tree *t, uint8_t lengths[static ALPHABET]) {
+  memset(lengths, 0, ALPHABET);
+  if (t && t->root != NO_NODE) {
+    tree_lengths(t, t->root, 0, lengths);
+    if (t->nodes[t->root].left == NO_NODE) {
+      lengths[t->nodes[t->root].symbol] = 1;
+    }
+  }
+  uint32_t max = 0;
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    max = lengths[i] > max ? lengths[i] : max;
+  }
+  return max;
+}
+
+// takes in histogram of uint64_t's of size ALPHABET, array of code lengths
+// computes the code lengths of a Huffman code for hist in linear time without
+// a tree of Nodes or any allocation: leaves are nodes 0 to ALPHABET - 1, each
+// merge of the two lightest adds the next node above, and only the parent of
+// each node is kept, 0 for absent symbols and 1 for a single symbol
+// returns the longest code length
+uint32_t optimal_lengths(uint64_t hist[static ALPHABET],
+                         uint8_t lengths[static ALPHABET]) {
+  uint64_t weight[2 * ALPHABET];
+  uint16_t parent[2 * ALPHABET];
+  uint8_t depth[2 * ALPHABET];
+  uint16_t sorted[ALPHABET];
+  memset(lengths, 0, ALPHABET);
+  uint32_t n = sort_symbols(hist, sorted);
+  if (n == 1) {
+    lengths[sorted[0]] = 1;
+  }
+  if (n <= 1) {
+    return n;
+  }
+  memcpy(weight, hist, ALPHABET * sizeof(uint64_t));
+  uint32_t leaf = 0;
+  uint32_t head = ALPHABET; // lightest parent not yet merged
+  uint32_t next = ALPHABET; // next parent
+  while ((n - leaf) + (next - head) > 1) { // merge the two lightest
+    uint16_t pair[2];
+    for (uint32_t k = 0; k < 2; k += 1) {
+      if (leaf < n && (head == next || weight[sorted[leaf]] <= weight[head])) {
+        pair[k] = sorted[leaf];
+        leaf += 1;
+      } else {
+        pair[k] = head;
+        head += 1;
+      }
+    }
+    weight[next] = weight[pair[0]] + weight[pair[1]];
+    parent[pair[0]] = next;
+    parent[pair[1]] = next;
+    next += 1;
+  }
+  depth[next - 1] = 0; // the root, parents always come after their children
+  for (uint32_t i = next - 1; i > ALPHABET; i -= 1) {
+    depth[i - 1] = depth[parent[i - 1]] + 1;
+  }
+  uint32_t max = 0;
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    if (hist[i] > 0) {
+      lengths[i] = depth[parent[i]] + 1;
+      max = lengths[i] > max ? lengths[i] : max;
+    }
+  }
+  return max;
+}
+
+// takes in histogram of uint64_t's of size ALPHABET, maximum code length,
+// array of code lengths
+// computes optimal code lengths of at most limit bits with package-merge: each
+// level merges the symbols with the pairs of the level below, and every time
+// a symbol is among the 2n - 2 cheapest items, its code grows by one bit
+// returns boolean if successful
+bool limit_lengths(uint64_t hist[static ALPHABET], uint32_t limit,
+                   uint8_t lengths[static ALPHABET]) {
+  uint16_t sorted[ALPHABET];
+  memset(lengths, 0, ALPHABET);
+  uint32_t n = sort_symbols(hist, sorted);
+  if (n <= 1) {
+    if (n == 1) {
+      lengths[sorted[0]] = 1;
+    }
+    return true;
+  }
+  while (limit < 32 && (1u << limit) < n) { // too short for n codes
+    limit += 1;
+  }
+
+  // items of each level: a symbol, or -1 for a package of two items below
+  uint32_t width = 2 * n;
+  int16_t *items = (int16_t *)malloc(limit * width * sizeof(int16_t));
+  uint64_t *weights = (uint64_t *)malloc(2 * width * sizeof(uint64_t));
+  uint32_t *sizes = (uint32_t *)malloc(limit * sizeof(uint32_t));
+  if (!items || !weights || !sizes) {
+    free(items);
+    free(weights);
+    free(sizes);
+    return false;
+  }
+  uint64_t *prev = weights;
+  uint64_t *cur = weights + width;
+  for (uint32_t level = 0; level < limit; level += 1) {
+    uint32_t packages = level == 0 ? 0 : sizes[level - 1] / 2;
+    uint32_t s = 0, p = 0, size = 0;
+    while (s < n || p < packages) { // merge symbols and packages by weight
+      uint64_t pw = p < packages ? prev[2 * p] + prev[2 * p + 1] : 0;
+      if (p == packages || (s < n && hist[sorted[s]] <= pw)) {
+        cur[size] = hist[sorted[s]];
+        items[level * width + size] = sorted[s];
+        s += 1;
+      } else {
+        cur[size] = pw;
+        items[level * width + size] = -1;
+        p += 1;
+      }
+      size += 1;
+    }
+    sizes[level] = size;
+    uint64_t *swap = prev;
+    prev = cur;
+    cur = swap;
+  }
+  uint32_t take = 2 * n - 2;
+  for (int32_t level = limit - 1; level >= 0; level -= 1) {
+    uint32_t packages = 0;
+    for (uint32_t i = 0; i < take; i += 1) {
+      int16_t item = items[level * width + i];
+      if (item < 0) {
+        packages += 1;
+      } else {
+        lengths[item] += 1;
+      }
+    }
+    take = 2 * packages;
+  }
+  free(items);
+  free(weights);
+  free(sizes);
+  return true;
+}
+
+// takes in array of code lengths of at most MAX_PACKED_BITS, PackedCode table
+// assigns canonical codes: codes of one length are consecutive integers in
+// symbol order, and shorter codes sort before longer ones
+void canonical_codes(uint8_t lengths[static ALPHABET],
+                     PackedCode table[static ALPHABET]) {
+  uint32_t count[MAX_PACKED_BITS + 1] = {0};
+  uint64_t next[MAX_PACKED_BITS + 1] = {0};
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    count[lengths[i]] += 1;
+  }
+  count[0] = 0;
+  uint64_t code = 0;
+  for (uint32_t len = 1; len <= MAX_PACKED_BITS; len += 1) {
+    code = (code + count[len - 1]) << 1;
+    next[len] = code;
+  }
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    uint32_t len = lengths[i];
+    table[i].length = len;
+    table[i].bits = 0;
+    if (len == 0) {
+      continue;
+    }
+    // canonical codes are read most significant bit first
+    for (uint32_t b = 0; b < len; b += 1) {
+      table[i].bits |= ((next[len] >> (len - 1 - b)) & 1) << b;
+    }
+    next[len] += 1;
+  }
+}
+
+// takes in array of code lengths, buffer of at least MAX_LENGTHS_SIZE bytes
+// stores the longest length, the number of symbols, the present symbols as a
+// list or, for 32 or more, as a bitmap, and then their lengths in symbol
+// order, packed two to a byte when no length exceeds 15
+// returns the number of bytes stored
+uint32_t pack_lengths(uint8_t lengths[static ALPHABET], uint8_t *buf) {
+  uint32_t n = 0;
+  memset(buf, 0, MAX_LENGTHS_SIZE);
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    buf[0] = lengths[i] > buf[0] ? lengths[i] : buf[0];
+    n += lengths[i] > 0;
+  }
+  if (n == 0) { // no symbols
+    return 1;
+  }
+  buf[1] = n - 1;
+  uint32_t size = 2 + (n < ALPHABET / 8 ? n : ALPHABET / 8);
+  n = 0;
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    if (lengths[i] == 0) {
+      continue;
+    }
+    if (buf[1] + 1 < ALPHABET / 8) {
+      buf[2 + n] = i;
+    } else {
+      buf[2 + i / 8] |= 1 << (i % 8);
+    }
+    if (buf[0] <= 15) {
+      buf[size + n / 2] |= lengths[i] << (4 * (n % 2));
+    } else {
+      buf[size + n] = lengths[i];
+    }
+    n += 1;
+  }
+  return size + (buf[0] <= 15 ? (n + 1) / 2 : n);
+}
+
+// takes in the first two bytes stored by pack_lengths()
+// returns the total number of bytes stored
+static uint32_t lengths_size(uint8_t max, uint8_t count) {
+  uint32_t n = count + 1;
+  if (max == 0) {
+    return 1;
+  }
+  return 2 + (n < ALPHABET / 8 ? n : ALPHABET / 8) +
+         (max <= 15 ? (n + 1) / 2 : n);
+}
+
+// takes in buffer of size bytes, array of code lengths
+// loads lengths stored by pack_lengths()
+// returns the number of bytes used, 0 unless they form a valid prefix code of
+// at most MAX_PACKED_BITS
+uint32_t unpack_lengths(uint8_t *buf, uint32_t size,
+                        uint8_t lengths[static ALPHABET]) {
+  uint8_t symbols[ALPHABET] = {0};
+  memset(lengths, 0, ALPHABET);
+  if (size < 1 || buf[0] > MAX_PACKED_BITS) {
+    return 0;
+  }
+  uint8_t max = buf[0];
+  if (max == 0) {
+    return 1;
+  }
+  if (size < 2 || size < lengths_size(max, buf[1])) {
+    return 0;
+  }
+  uint32_t n = buf[1] + 1;
+  uint8_t *packed = buf + 2 + n;
+  if (n < ALPHABET / 8) { // symbol list
+    memcpy(symbols, buf + 2, n);
+  } else { // symbol bitmap
+    uint32_t present = 0;
+    for (uint32_t i = 0; i < ALPHABET; i += 1) {
+      if ((buf[2 + i / 8] >> (i % 8)) & 1) {
+        symbols[present] = i;
+        present += 1;
+      }
+    }
+    if (present != n) {
+      return 0;
+    }
+    packed = buf + 2 + ALPHABET / 8;
+  }
+  uint32_t count[MAX_PACKED_BITS + 1] = {0};
+  for (uint32_t i = 0; i < n; i += 1) {
+    uint8_t len = max <= 15 ? (packed[i / 2] >> (4 * (i % 2))) & 0xF
+                            : packed[i];
+    if (len == 0 || len > max || lengths[symbols[i]] != 0) {
+      return 0;
+    }
+    lengths[symbols[i]] = len;
+    count[len] += 1;
+  }
+  uint64_t left = 1; // codes still available at the current length
+  for (uint32_t len = 1; len <= max; len += 1) {
+    left <<= 1;
+    if (count[len] > left) { // oversubscribed
+      return 0;
+    }
+    left -= count[len];
+    left = left > ALPHABET ? ALPHABET : left;
+  }
+  return lengths_size(max, buf[1]);
+}
+
+// takes in outfile file descriptor, array of code lengths
+// writes lengths as stored by pack_lengths()
+void dump_lengths(int outfile, uint8_t lengths[static ALPHABET]) {
+  uint8_t buf[MAX_LENGTHS_SIZE];
+  write_bytes(outfile, buf, pack_lengths(lengths, buf));
+}
+
+// takes in infile file descriptor, array of code lengths
+// reads lengths written by dump_lengths()
+// returns boolean if they form a valid prefix code of at most MAX_PACKED_BITS
+bool read_lengths(int infile, uint8_t lengths[static ALPHABET]) {
+  uint8_t buf[MAX_LENGTHS_SIZE] = {0};
+  if (read_bytes(infile, buf, 1) != 1) {
+    return false;
+  }
+  if (buf[0] != 0 && read_bytes(infile, buf + 1, 1) != 1) {
+    return false;
+  }
+  int32_t size = lengths_size(buf[0], buf[1]);
+  if (size > 2 && read_bytes(infile, buf + 2, size - 2) != size - 2) {
+    return false;
   }
+  return unpack_lengths(buf, size, lengths) > 0;
 }
@@ -5,12 +5,30 @@
 #include "node.h"
 #include <stdint.h>
 
-Node *build_tree(uint64_t hist[static ALPHABET]);
+Tree *build_tree(uint64_t hist[static ALPHABET]);
 
-void build_codes(Node *root, Code table[static ALPHABET]);
+void build_codes(Tree *t, Code table[static ALPHABET]);
 
-void dump_tree(int outfile, Node *root);
+void dump_tree(int outfile, Tree *t);
 
-Node *rebuild_tree(uint16_t nbytes, uint8_t tree[static nbytes]);
+Tree *rebuild_tree(uint16_t nbytes, uint8_t tree[static nbytes]);
 
-void delete_tree(Node **root);
+uint32_t build_lengths(Tree *t, uint8_t lengths[static ALPHABET]);
+
+uint32_t optimal_lengths(uint64_t hist[static ALPHABET],
+                         uint8_t lengths[static ALPHABET]);
+
+bool limit_lengths(uint64_t hist[static ALPHABET], uint32_t limit,
+                   uint8_t lengths[static ALPHABET]);
+
+void canonical_codes(uint8_t lengths[static ALPHABET],
+                     PackedCode table[static ALPHABET]);
+
+uint32_t pack_lengths(uint8_t lengths[static ALPHABET], uint8_t *buf);
+
+uint32_t unpack_lengths(uint8_t *buf, uint32_t size,
+                        uint8_t lengths[static ALPHABET]);
+
+void dump_lengths(int outfile, uint8_t lengths[static ALPHABET]);
+
+bool read_lengths(int infile, uint8_t lengths[static ALPHABET]);
@@ -1,110 +1,305 @@
 
+#include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "code.h"
 #include "io.h"
+#include "stats.h"
 
-uint64_t bytes_read = 0;                  // track total bytes that are read
-uint64_t bytes_written = 0;               // tracks total bytes that are written
-static uint8_t read_buffer[BLOCK] = {0};  // buffer for bytes being read
-static uint8_t write_buffer[BLOCK] = {0}; // bytes for bytes being written
-static uint32_t buff_index = 0;           // tracks index in the buffer
+_Atomic uint64_t bytes_read = 0;    // track total bytes that are read
+_Atomic uint64_t bytes_written = 0; // tracks total bytes that are written
+_Atomic uint64_t read_calls = 0;       // read and pread system calls
+_Atomic uint64_t write_calls = 0;      // write and pwrite system calls
+_Atomic uint64_t read_call_bytes = 0;  // bytes moved by read_calls
+_Atomic uint64_t write_call_bytes = 0; // bytes moved by write_calls
+
+// takes in result of a read or write system call, whether it wrote
+// counts the call and the bytes it moved
+static inline void count_call(ssize_t n, bool write) {
+  if (write) {
+    write_calls += 1;
+    write_call_bytes += n > 0 ? n : 0;
+  } else {
+    read_calls += 1;
+    read_call_bytes += n > 0 ? n : 0;
+  }
+}
 
 // takes in infile descriptor, buffer, number of bytes
 // read nbytes from infile into buf
 // return the number of bytes read
 int read_bytes(int infile, uint8_t *buf, int nbytes) {
   uint32_t bytes_read_here = 0;
-  uint64_t bytes_counter = 0;
+  ssize_t bytes_counter = 0;
   if (nbytes == 0) {
     return 0;
   }
+  uint32_t phase = stats_phase(PHASE_IO);
   while ((bytes_counter = read(infile, buf + bytes_read_here,
                                nbytes - bytes_read_here)) > 0) {
+    count_call(bytes_counter, false);
     bytes_read_here += bytes_counter;
-    if (bytes_read == (uint64_t)nbytes) {
+    if (bytes_read_here == (uint32_t)nbytes) {
       break;
     }
   }
+  if (bytes_counter <= 0) {
+    count_call(bytes_counter, false);
+  }
+  stats_phase(phase);
+  bytes_read += bytes_read_here;
+  return bytes_read_here;
+}
+
+// takes in infile descriptor, buffer, number of bytes
+// read what infile has ready into buf, up to nbytes, waiting only while
+// nothing is ready
+// return the number of bytes read, 0 at the end of infile
+int read_some(int infile, uint8_t *buf, int nbytes) {
+  ssize_t bytes_read_here = 0;
+  uint32_t phase = stats_phase(PHASE_IO);
+  do {
+    bytes_read_here = read(infile, buf, nbytes);
+    count_call(bytes_read_here, false);
+  } while (bytes_read_here == -1 && errno == EINTR);
+  stats_phase(phase);
+  if (bytes_read_here < 0) {
+    return 0;
+  }
   bytes_read += bytes_read_here;
   return bytes_read_here;
 }
 
 // takes in outfile descriptor, buffer, number of bytes
-// write nbytes from the buffer into outfile
+// write nbytes from the buffer into outfile, or only count them when outfile
+// is -1, as when testing a compressed file
 // returns the number of bytes written
 int write_bytes(int outfile, uint8_t *buf, int nbytes) {
   uint32_t bytes_written_here = 0;
-  uint32_t bytes_counter = 0;
+  ssize_t bytes_counter = 0;
   if (nbytes == 0) {
     return 0;
   }
+  if (outfile == -1) {
+    bytes_written += nbytes;
+    return nbytes;
+  }
+  uint32_t phase = stats_phase(PHASE_IO);
   while ((bytes_counter = write(outfile, buf + bytes_written_here,
                                 nbytes - bytes_written_here)) > 0) {
+    count_call(bytes_counter, true);
     bytes_written_here += bytes_counter;
-    if (bytes_written_here == (uint32_t)nbytes ||
-        bytes_written_here == bytes_read) {
+    if (bytes_written_here == (uint32_t)nbytes) {
       break;
     }
   }
+  if (bytes_counter <= 0) {
+    count_call(bytes_counter, true);
+  }
+  stats_phase(phase);
   bytes_written += bytes_written_here;
   return bytes_written_here;
 }
 
-// takes in infile descriptor, bit
-// read bit from infile and return value through bit
-// returns boolean if there are still bits to read
-bool read_bit(int infile, uint8_t *bit) {
-  static uint32_t index = 0;
-  static uint32_t buff_size;
-  if (index == 0) {
-    buff_size = read_bytes(infile, read_buffer, BLOCK);
+// takes in infile descriptor, buffer, number of bytes, file offset
+// read nbytes at offset of infile into buf, without moving the file offset or
+// counting towards bytes_read, so that threads may share infile
+// return the number of bytes read
+int pread_bytes(int infile, uint8_t *buf, int nbytes, uint64_t offset) {
+  int bytes_read_here = 0;
+  uint32_t phase = stats_phase(PHASE_IO);
+  while (bytes_read_here < nbytes) {
+    ssize_t n = pread(infile, buf + bytes_read_here, nbytes - bytes_read_here,
+                      offset + bytes_read_here);
+    count_call(n, false);
+    if (n <= 0) {
+      break;
+    }
+    bytes_read_here += n;
+  }
+  stats_phase(phase);
+  return bytes_read_here;
+}
+
+// takes in outfile descriptor, buffer, number of bytes, file offset
+// write nbytes from buf at offset of outfile, without moving the file offset
+// or counting towards bytes_written, so that threads may share outfile
+// returns the number of bytes written
+int pwrite_bytes(int outfile, uint8_t *buf, int nbytes, uint64_t offset) {
+  int bytes_written_here = 0;
+  uint32_t phase = stats_phase(PHASE_IO);
+  while (bytes_written_here < nbytes) {
+    ssize_t n = pwrite(outfile, buf + bytes_written_here,
+                       nbytes - bytes_written_here,
+                       offset + bytes_written_here);
+    count_call(n, true);
+    if (n <= 0) {
+      break;
+    }
+    bytes_written_here += n;
   }
-  if (buff_size == 0) {
-    return false;
+  stats_phase(phase);
+  return bytes_written_here;
+}
+
+// takes in infile descriptor, pointer for the size of infile
+// maps a regular infile read-only for a front to back scan, so that it can be
+// read in place without read() copies, without counting towards bytes_read
+// returns the mapping, NULL for pipes and other inputs to read with read_bytes
+uint8_t *map_input(int infile, uint64_t *size) {
+  struct stat stats;
+  if (fstat(infile, &stats) == -1 || !S_ISREG(stats.st_mode) ||
+      stats.st_size == 0) {
+    return NULL;
   }
-  *bit = (read_buffer[index / 8] >> (index % 8)) & 1;
-  index += 1;
-  if (index == buff_size * 8) {
-    index = 0;
+  uint8_t *map = mmap(NULL, stats.st_size, PROT_READ, MAP_PRIVATE, infile, 0);
+  if (map == MAP_FAILED) {
+    return NULL;
   }
-  return true;
+  madvise(map, stats.st_size, MADV_SEQUENTIAL);
+  *size = stats.st_size;
+  return map;
 }
 
-// takes in outfile descriptor, code c
-// write bits from c into a static buffer and write out contents of buffer into
-// outfile
-void write_code(int outfile, Code *c) {
-  static uint32_t buff_size = 0;
-  for (uint32_t i = 0; i < code_size(c); i += 1) {
-    uint8_t bit = code_get_bit(c, i);
-    if (bit == 1) {
-      write_buffer[buff_index / 8] |= (1 << buff_index % 8);
-    } else {
-      write_buffer[buff_index / 8] &= ~(1 << buff_index % 8);
-    }
-    buff_index += 1;
-    if (buff_index == BLOCK * 8) {
-      write_bytes(outfile, write_buffer, BLOCK);
-      buff_size += BLOCK;
-      buff_index = 0;
+// takes in mapping from map_input or NULL, size of the mapping
+// unmaps the input
+void unmap_input(uint8_t *map, uint64_t size) {
+  if (map) {
+    munmap(map, size);
+  }
+}
+
+// takes in BitReader r, infile descriptor, buffer, size of buffer
+// prepares r to read bits from infile through buffer, or when infile is -1
+// to read the size bytes already in buffer
+void bit_reader_init(BitReader *r, int infile, uint8_t *buffer,
+                     uint64_t size) {
+  r->infile = infile;
+  r->eof = infile < 0;
+  r->index = 0;
+  r->size = infile < 0 ? size : 0;
+  r->capacity = size;
+  r->count = 0;
+  r->bits = 0;
+  r->buffer = buffer;
+}
+
+// takes in BitReader r
+// tops up the accumulator so it holds at least 57 bits, past the end of the
+// infile the accumulator is padded with zero bits
+void bit_reader_refill(BitReader *r) {
+  while (r->count <= 56) {
+    if (r->index == r->size) {
+      if (!r->eof) {
+        r->size = read_bytes(r->infile, r->buffer, r->capacity);
+        r->index = 0;
+      }
+      if (r->eof || r->size == 0) {
+        r->eof = true;
+        r->count = 64; // high bits are already zero
+        return;
+      }
     }
+    r->bits |= (uint64_t)r->buffer[r->index] << r->count;
+    r->index += 1;
+    r->count += 8;
   }
 }
 
-// takes in outfile descriptor
-// write out any extra bits in buffer
-void flush_codes(int outfile) {
-  static uint32_t buff_size = 0;
-  if (buff_index % 8 == 0) {
-    write_bytes(outfile, write_buffer, buff_index / 8);
-    buff_size += buff_index / 8;
-  } else {
-    write_buffer[buff_index / 8] &= ((1 << (buff_index % 8)) - 1);
-    write_bytes(outfile, write_buffer, buff_index / 8 + 1);
+// takes in BitWriter w, outfile descriptor, buffer, capacity of buffer
+// prepares w to write bits to outfile through buffer, or when outfile is -1
+// into buffer, which must then hold every word written
+void bit_writer_init(BitWriter *w, int outfile, uint8_t *buffer,
+                     uint32_t capacity) {
+  w->outfile = outfile;
+  w->index = 0;
+  w->capacity = capacity & ~7u;
+  w->buffer = buffer;
+  w->count = 0;
+  w->bits = 0;
+}
+
+// takes in BitWriter w, 64-bit word
+// stores word in little-endian order and writes out the buffer once full
+static void put_word(BitWriter *w, uint64_t word) {
+  for (uint32_t i = 0; i < 8; i += 1) {
+    w->buffer[w->index + i] = word >> (8 * i);
+  }
+  w->index += 8;
+  if (w->index == w->capacity && w->outfile >= 0) {
+    write_bytes(w->outfile, w->buffer, w->index);
+    w->index = 0;
+  }
+}
+
+// takes in BitWriter w, bits and their length of at most 64
+// appends bits to the accumulator, storing it whenever a word fills up
+static inline void put_bits(BitWriter *w, uint64_t bits, uint32_t length) {
+  w->bits |= bits << w->count;
+  if (w->count + length < 64) {
+    w->count += length;
+    return;
+  }
+  put_word(w, w->bits);
+  uint32_t used = 64 - w->count; // bits of the code already stored
+  w->bits = used < 64 ? bits >> used : 0;
+  w->count = w->count + length - 64;
+}
+
+// takes in BitWriter w, PackedCode table, buffer, number of bytes
+// writes the code of each of the nbytes symbols in buf, every code must be at
+// most MAX_PACKED_BITS long
+void write_symbols(BitWriter *w, PackedCode table[static ALPHABET],
+                   uint8_t *buf, uint32_t nbytes) {
+  for (uint32_t i = 0; i < nbytes; i += 1) {
+    PackedCode *c = &table[buf[i]];
+    put_bits(w, c->bits, c->length);
+  }
+}
+
+// takes in BitWriter w, PackedCode table of each context group, group of
+// each previous byte, buffer, number of bytes
+// writes the code of each of the nbytes symbols in buf from the table of the
+// group of the byte before it, group map[0] for the first, every code must be
+// at most MAX_PACKED_BITS long
+void write_context_symbols(BitWriter *w, PackedCode tables[][ALPHABET],
+                           uint8_t map[static ALPHABET], uint8_t *buf,
+                           uint32_t nbytes) {
+  uint8_t prev = 0;
+  for (uint32_t i = 0; i < nbytes; i += 1) {
+    PackedCode *c = &tables[map[prev]][buf[i]];
+    put_bits(w, c->bits, c->length);
+    prev = buf[i];
+  }
+}
+
+// takes in BitWriter w, Code c
+// writes c a bit at a time, for codes too long to pack
+void write_code(BitWriter *w, Code *c) {
+  for (uint32_t i = 0; i < code_size(c); i += 1) {
+    put_bits(w, code_get_bit(c, i), 1);
+  }
+}
+
+// takes in BitWriter w
+// stores any pending bits, padding the last byte with 0s, and writes out the
+// buffer unless writing to memory
+// returns the number of bytes in the buffer, 0 once written out
+uint32_t bit_writer_flush(BitWriter *w) {
+  for (uint32_t i = 0; i < w->count; i += 8) {
+    w->buffer[w->index] = w->bits >> i;
+    w->index += 1;
+  }
+  w->count = 0;
+  w->bits = 0;
+  if (w->outfile >= 0) {
+    write_bytes(w->outfile, w->buffer, w->index);
+    w->index = 0;
   }
-  buff_index = 0;
+  return w->index;
 }
@@ -1,18 +1,70 @@
 #pragma once
 
 #include "code.h"
+#include "defines.h"
 #include <stdbool.h>
 #include <stdint.h>
 
-extern uint64_t bytes_read;
-extern uint64_t bytes_written;
+// 64-bit bit accumulator over a buffered infile, or over a buffer in memory
+// when infile is -1, least significant bit first
+typedef struct {
+  int infile;
+  bool eof;
+  uint64_t index;    // next unread byte in buffer
+  uint64_t size;     // number of valid bytes in buffer
+  uint32_t capacity; // size of buffer
+  uint32_t count;    // number of valid bits in the accumulator
+  uint64_t bits;     // accumulator, next bit in the lowest position
+  uint8_t *buffer;
+} BitReader;
+
+// 64-bit bit accumulator flushing whole words to a buffered outfile, or into
+// a buffer in memory when outfile is -1
+typedef struct {
+  int outfile;
+  uint32_t index;    // next free byte in buffer
+  uint32_t capacity; // size of buffer, a multiple of 8
+  uint32_t count;    // number of pending bits in the accumulator
+  uint64_t bits;     // accumulator, next bit goes above the pending ones
+  uint8_t *buffer;
+} BitWriter;
+
+extern _Atomic uint64_t bytes_read;
+extern _Atomic uint64_t bytes_written;
+extern _Atomic uint64_t read_calls;
+extern _Atomic uint64_t write_calls;
+extern _Atomic uint64_t read_call_bytes;
+extern _Atomic uint64_t write_call_bytes;
 
 int read_bytes(int infile, uint8_t *buf, int nbytes);
 
+int read_some(int infile, uint8_t *buf, int nbytes);
+
 int write_bytes(int outfile, uint8_t *buf, int nbytes);
 
-bool read_bit(int infile, uint8_t *bit);
+int pread_bytes(int infile, uint8_t *buf, int nbytes, uint64_t offset);
+
+int pwrite_bytes(int outfile, uint8_t *buf, int nbytes, uint64_t offset);
+
+uint8_t *map_input(int infile, uint64_t *size);
+
+void unmap_input(uint8_t *map, uint64_t size);
+
+void bit_reader_init(BitReader *r, int infile, uint8_t *buffer,
+                     uint64_t size);
+
+void bit_reader_refill(BitReader *r);
+
+void bit_writer_init(BitWriter *w, int outfile, uint8_t *buffer,
+                     uint32_t capacity);
+
+void write_symbols(BitWriter *w, PackedCode table[static ALPHABET],
+                   uint8_t *buf, uint32_t nbytes);
+
+void write_context_symbols(BitWriter *w, PackedCode tables[][ALPHABET],
+                           uint8_t map[static ALPHABET], uint8_t *buf,
+                           uint32_t nbytes);
 
-void write_code(int outfile, Code *c);
+void write_code(BitWriter *w, Code *c);
 
-void flush_codes(int outfile);
+uint32_t bit_writer_flush(BitWriter *w);
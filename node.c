@@ -1,4 +1,3 @@
-
 #include "node.h"
 #include "defines.h"
 #include <inttypes.h>
@@ -6,36 +5,53 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-// takes in symbol and frequency
-// constructor for node
-// returns node
-Node *node_create(uint8_t symbol, uint64_t frequency) {
-  Node *node = (Node *)malloc(sizeof(Node));
-  if (node) {
-    node->left = NULL;
-    node->right = NULL;
-    node->symbol = symbol;
-    node->frequency = frequency;
+// constructor for an empty tree, the arena for all of its nodes
+// returns tree
+Tree *tree_create(void) {
+  Tree *t = (Tree *)malloc(sizeof(Tree));
+  if (t) {
+    t->size = 0;
+    t->root = NO_NODE;
   }
-  return node;
+  return t;
 }
 
-// takes in node double pointer
-// destructor for node
-void node_delete(Node **n) {
-  if (*n) {
-    free(*n);
-    *n = NULL;
+// takes in tree double pointer
+// destructor for tree, freeing every node at once
+void tree_delete(Tree **t) {
+  if (*t) {
+    free(*t);
+    *t = NULL;
   }
 }
 
-// takes in left and right child nodes
-// joins left and right child nodes to create a parent node
-// returns parent node
-Node *node_join(Node *left, Node *right) {
-  Node *n = node_create('$', left->frequency + right->frequency);
-  n->left = left;
-  n->right = right;
+// takes in tree, symbol and frequency
+// constructor for a leaf node in the arena of t
+// returns node, NULL once t holds MAX_NODES
+Node *node_create(Tree *t, uint8_t symbol, uint64_t frequency) {
+  if (t->size == MAX_NODES) {
+    return NULL;
+  }
+  Node *node = &t->nodes[t->size];
+  t->size += 1;
+  node->left = NO_NODE;
+  node->right = NO_NODE;
+  node->symbol = symbol;
+  node->frequency = frequency;
+  return node;
+}
+
+// takes in tree, left and right child nodes of t
+// joins left and right child nodes to create a parent node, which becomes
+// the root of t
+// returns parent node, NULL once t holds MAX_NODES
+Node *node_join(Tree *t, Node *left, Node *right) {
+  Node *n = node_create(t, '$', left->frequency + right->frequency);
+  if (n) {
+    n->left = left - t->nodes;
+    n->right = right - t->nodes;
+    t->root = n - t->nodes;
+  }
   return n;
 }
 
@@ -45,13 +61,6 @@ void node_print(Node *n) {
   if (!n) {
     return;
   }
-  printf("parent: %d - %" PRIu64 "\n", n->symbol, n->frequency);
-  if (n->left != NULL) {
-    printf("\t");
-    node_print(n->left);
-  }
-  if (n->right != NULL) {
-    printf("\t");
-    node_print(n->right);
-  }
+  printf("node: %d - %" PRIu64 ", children %d %d\n", n->symbol, n->frequency,
+         n->left, n->right);
 }
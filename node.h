@@ -1,20 +1,32 @@
 #pragma once
 
+#include "defines.h"
 #include <stdint.h>
 
+#define NO_NODE UINT16_MAX // child index of a leaf
+
 typedef struct Node Node;
 
 struct Node {
-  Node *left;
-  Node *right;
-  uint8_t symbol;
   uint64_t frequency;
+  uint16_t left;  // index of the left child in its tree, NO_NODE for a leaf
+  uint16_t right; // index of the right child in its tree, NO_NODE for a leaf
+  uint8_t symbol;
 };
 
-Node *node_create(uint8_t symbol, uint64_t frequency);
+// every node of a Huffman tree in one allocation, children before parents
+typedef struct {
+  uint16_t size; // nodes in use
+  uint16_t root; // index of the root, NO_NODE while empty
+  Node nodes[MAX_NODES];
+} Tree;
+
+Tree *tree_create(void);
+
+void tree_delete(Tree **t);
 
-void node_delete(Node **n);
+Node *node_create(Tree *t, uint8_t symbol, uint64_t frequency);
 
-Node *node_join(Node *left, Node *right);
+Node *node_join(Tree *t, Node *left, Node *right);
 
 void node_print(Node *n);
@@ -0,0 +1,123 @@
+#include "pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// defines thread pool struct: workers take tasks from a FIFO queue
+struct Pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work; // signalled when a task is queued or on shutdown
+  pthread_cond_t done; // broadcast when a task finishes
+  Task *head;
+  Task *tail;
+  bool stop;
+  uint32_t threads;
+  pthread_t *workers;
+};
+
+// takes in pool
+// runs queued tasks until the pool shuts down
+static void *worker(void *arg) {
+  Pool *p = (Pool *)arg;
+  pthread_mutex_lock(&p->lock);
+  while (true) {
+    while (!p->stop && !p->head) {
+      pthread_cond_wait(&p->work, &p->lock);
+    }
+    if (!p->head) { // stopping and nothing left to run
+      break;
+    }
+    Task *t = p->head;
+    p->head = t->next;
+    if (!p->head) {
+      p->tail = NULL;
+    }
+    pthread_mutex_unlock(&p->lock);
+    t->run(t->arg);
+    pthread_mutex_lock(&p->lock);
+    t->done = true;
+    pthread_cond_broadcast(&p->done);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+// takes in number of worker threads
+// constructor for thread pool, with 0 or 1 threads tasks run on submission
+// returns pool
+Pool *pool_create(uint32_t threads) {
+  Pool *p = (Pool *)calloc(1, sizeof(Pool));
+  if (p) {
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+    if (threads > 1) {
+      p->workers = (pthread_t *)malloc(threads * sizeof(pthread_t));
+      if (!p->workers) {
+        pool_delete(&p);
+        return NULL;
+      }
+      for (uint32_t i = 0; i < threads; i += 1) {
+        if (pthread_create(&p->workers[i], NULL, worker, p) != 0) {
+          break;
+        }
+        p->threads += 1;
+      }
+    }
+  }
+  return p;
+}
+
+// takes in double pointer to pool
+// destructor for pool, finishes queued tasks and joins the workers
+void pool_delete(Pool **p) {
+  if (*p) {
+    pthread_mutex_lock(&(*p)->lock);
+    (*p)->stop = true;
+    pthread_cond_broadcast(&(*p)->work);
+    pthread_mutex_unlock(&(*p)->lock);
+    for (uint32_t i = 0; i < (*p)->threads; i += 1) {
+      pthread_join((*p)->workers[i], NULL);
+    }
+    pthread_mutex_destroy(&(*p)->lock);
+    pthread_cond_destroy(&(*p)->work);
+    pthread_cond_destroy(&(*p)->done);
+    free((*p)->workers);
+    free(*p);
+    *p = NULL;
+  }
+}
+
+// takes in pool
+// returns the number of worker threads, 0 if tasks run on submission
+uint32_t pool_threads(Pool *p) { return p->threads; }
+
+// takes in pool, task t which must stay valid until it is done
+// queues t to run on a worker, or runs it right away without workers
+void pool_submit(Pool *p, Task *t) {
+  t->done = false;
+  t->next = NULL;
+  if (p->threads == 0) {
+    t->run(t->arg);
+    t->done = true;
+    return;
+  }
+  pthread_mutex_lock(&p->lock);
+  if (p->tail) {
+    p->tail->next = t;
+  } else {
+    p->head = t;
+  }
+  p->tail = t;
+  pthread_cond_signal(&p->work);
+  pthread_mutex_unlock(&p->lock);
+}
+
+// takes in pool, submitted task t
+// blocks until t has run
+void pool_wait(Pool *p, Task *t) {
+  pthread_mutex_lock(&p->lock);
+  while (!t->done) {
+    pthread_cond_wait(&p->done, &p->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
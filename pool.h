@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Task Task;
+
+struct Task {
+  void (*run)(void *arg);
+  void *arg;
+  bool done;
+  Task *next;
+};
+
+typedef struct Pool Pool;
+
+Pool *pool_create(uint32_t threads);
+
+void pool_delete(Pool **p);
+
+uint32_t pool_threads(Pool *p);
+
+void pool_submit(Pool *p, Task *t);
+
+void pool_wait(Pool *p, Task *t);
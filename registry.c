@@ -0,0 +1,255 @@
+#include "registry.h"
+#include "header.h"
+#include "huffman.h"
+#include "io.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// a trained code and its decode table, prepared once and then only read, so
+// that any number of threads can share it
+typedef struct {
+  uint32_t id;
+  uint8_t lengths[ALPHABET]; // tells apart codes whose IDs collide
+  PackedCode codes[ALPHABET];
+  DecodeTable decoder;
+} Trained;
+
+// defines registry struct: the trained codes loaded, found by their ID
+struct Registry {
+  Trained **tables;
+  uint32_t count;
+  uint32_t capacity;
+};
+
+// constructor for an empty registry
+// returns registry
+Registry *registry_create(void) {
+  return (Registry *)calloc(1, sizeof(Registry));
+}
+
+// takes in registry double pointer
+// destructor for registry and every table in it
+void registry_delete(Registry **r) {
+  if (*r) {
+    for (uint32_t i = 0; i < (*r)->count; i += 1) {
+      free((*r)->tables[i]);
+    }
+    free((*r)->tables);
+    free(*r);
+    *r = NULL;
+  }
+}
+
+// takes in histogram of a sample corpus, array of code lengths
+// computes code lengths for the corpus in which every symbol has a code, so
+// that any message can be coded, none longer than TRAINED_LIMIT
+// returns boolean if successful
+bool train_lengths(uint64_t hist[static ALPHABET],
+                   uint8_t lengths[static ALPHABET]) {
+  uint64_t most = 0;
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    most = hist[i] > most ? hist[i] : most;
+  }
+  uint32_t shift = 0; // scales a huge corpus so the weights and their sum fit
+  while ((most >> shift) > (UINT64_MAX / ALPHABET - 1) / ALPHABET) {
+    shift += 1;
+  }
+  uint64_t weights[ALPHABET];
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    weights[i] = (hist[i] >> shift) * ALPHABET + 1; // unseen stay possible
+  }
+  if (optimal_lengths(weights, lengths) > TRAINED_LIMIT) {
+    return limit_lengths(weights, TRAINED_LIMIT, lengths);
+  }
+  return true;
+}
+
+// takes in array of code lengths
+// returns the ID of the code, an FNV-1a hash of its lengths, so that tables
+// with the same code share an ID wherever they are trained
+static uint32_t lengths_id(uint8_t lengths[static ALPHABET]) {
+  uint32_t hash = 2166136261u;
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    hash = (hash ^ lengths[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// takes in registry, ID
+// returns the table with the ID, NULL if none is loaded
+static Trained *registry_find(Registry *r, uint32_t id) {
+  for (uint32_t i = 0; i < r->count; i += 1) {
+    if (r->tables[i]->id == id) {
+      return r->tables[i];
+    }
+  }
+  return NULL;
+}
+
+// takes in registry, array of code lengths, pointer for the ID
+// adds the code and its prepared decode table to r, unless already there;
+// every symbol must have a code of at most MAX_PACKED_BITS
+// returns boolean if successful, false with the ID set if a different code
+// with the same ID is already loaded
+bool registry_add(Registry *r, uint8_t lengths[static ALPHABET],
+                  uint32_t *id) {
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    if (lengths[i] == 0 || lengths[i] > MAX_PACKED_BITS) {
+      return false;
+    }
+  }
+  *id = lengths_id(lengths);
+  Trained *found = registry_find(r, *id);
+  if (found) {
+    return memcmp(found->lengths, lengths, ALPHABET) == 0;
+  }
+  if (r->count == r->capacity) {
+    uint32_t capacity = r->capacity ? 2 * r->capacity : 8;
+    Trained **tables =
+        (Trained **)realloc(r->tables, capacity * sizeof(Trained *));
+    if (!tables) {
+      return false;
+    }
+    r->tables = tables;
+    r->capacity = capacity;
+  }
+  Trained *t = (Trained *)malloc(sizeof(Trained));
+  if (!t) {
+    return false;
+  }
+  t->id = *id;
+  memcpy(t->lengths, lengths, ALPHABET);
+  canonical_codes(lengths, t->codes);
+  Code codes[ALPHABET];
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    codes[i] = code_unpack(&t->codes[i]);
+  }
+  table_init(&t->decoder, codes);
+  r->tables[r->count] = t;
+  r->count += 1;
+  return true;
+}
+
+// takes in array of code lengths, path of the table file, pointer for the ID
+// writes TABLE_MAGIC, the ID and the lengths as stored by pack_lengths()
+// returns boolean if successful
+bool registry_save(uint8_t lengths[static ALPHABET], const char *path,
+                   uint32_t *id) {
+  uint8_t buf[8 + MAX_LENGTHS_SIZE];
+  uint32_t magic = TABLE_MAGIC;
+  *id = lengths_id(lengths);
+  memcpy(buf, &magic, 4);
+  memcpy(buf + 4, id, 4);
+  int32_t size = 8 + pack_lengths(lengths, buf + 8);
+  int outfile = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (outfile == -1) {
+    return false;
+  }
+  bool ok = write_bytes(outfile, buf, size) == size;
+  return close(outfile) == 0 && ok;
+}
+
+// takes in registry, path of a table file, pointer for the ID
+// adds the table written by registry_save() to r
+// returns boolean if the file holds a valid table, false with the ID set if
+// its ID is taken by a different table already loaded
+bool registry_load(Registry *r, const char *path, uint32_t *id) {
+  uint8_t buf[8 + MAX_LENGTHS_SIZE];
+  int infile = open(path, O_RDONLY);
+  if (infile == -1) {
+    return false;
+  }
+  int32_t size = read_bytes(infile, buf, sizeof(buf));
+  close(infile);
+  uint32_t magic = 0;
+  uint32_t stored = 0;
+  uint8_t lengths[ALPHABET];
+  if (size < 8) {
+    return false;
+  }
+  memcpy(&magic, buf, 4);
+  memcpy(&stored, buf + 4, 4);
+  return magic == TABLE_MAGIC &&
+         unpack_lengths(buf + 8, size - 8, lengths) == (uint32_t)size - 8 &&
+         lengths_id(lengths) == stored && registry_add(r, lengths, id);
+}
+
+// takes in registry, ID
+// returns the codes of the table with the ID, NULL if none is loaded
+PackedCode *registry_codes(Registry *r, uint32_t id) {
+  Trained *t = registry_find(r, id);
+  return t ? t->codes : NULL;
+}
+
+// takes in registry, ID
+// returns the prepared decode table with the ID, NULL if none is loaded
+DecodeTable *registry_decoder(Registry *r, uint32_t id) {
+  Trained *t = registry_find(r, id);
+  return t ? &t->decoder : NULL;
+}
+
+// takes in number of bytes
+// returns the most bytes registry_compress() can store for nbytes: the
+// header, the ID and codes of at most TRAINED_LIMIT bits, plus the padding
+// of the last word
+uint64_t registry_bound(uint64_t nbytes) {
+  return sizeof(Header) + 4 + (nbytes * TRAINED_LIMIT + 7) / 8 + 16;
+}
+
+// takes in registry, ID of a table, source buffer of nbytes, at most
+// MAX_BLOCK_SIZE, destination buffer of capacity bytes
+// compresses src with the trained table in a single pass and without
+// allocating: the header, the ID and then the bitstream
+// returns the number of bytes stored in dst, -1 if the table is not loaded,
+// nbytes is too large or capacity is less than registry_bound(nbytes)
+int64_t registry_compress(Registry *r, uint32_t id, uint8_t *src,
+                          uint64_t nbytes, uint8_t *dst, uint64_t capacity) {
+  Trained *t = registry_find(r, id);
+  if (!t || nbytes > MAX_BLOCK_SIZE || capacity < registry_bound(nbytes)) {
+    return -1;
+  }
+  Header header;
+  header.magic = MAGIC_VERSIONED;
+  header.permissions = 0600;
+  header.version = VERSION_TRAINED;
+  header.flags = 0;
+  header.file_size = nbytes;
+  memcpy(dst, &header, sizeof(header));
+  memcpy(dst + sizeof(header), &id, 4);
+  BitWriter w;
+  bit_writer_init(&w, -1, dst + sizeof(header) + 4,
+                  registry_bound(nbytes) - sizeof(header) - 4);
+  write_symbols(&w, t->codes, src, nbytes);
+  return sizeof(header) + 4 + bit_writer_flush(&w);
+}
+
+// takes in registry, source buffer of size bytes from registry_compress(),
+// destination buffer of capacity bytes
+// decodes src with the prepared table named in it
+// returns the number of bytes stored in dst, -1 if src is not a trained
+// message, its table is not loaded or it does not fit in capacity
+int64_t registry_decompress(Registry *r, uint8_t *src, uint64_t size,
+                            uint8_t *dst, uint64_t capacity) {
+  Header header;
+  uint32_t id;
+  if (size < sizeof(header) + 4) {
+    return -1;
+  }
+  memcpy(&header, src, sizeof(header));
+  memcpy(&id, src + sizeof(header), 4);
+  DecodeTable *t = registry_decoder(r, id);
+  if (header.magic != MAGIC_VERSIONED || header.version != VERSION_TRAINED ||
+      header.flags != 0 || !t || header.file_size > capacity) {
+    return -1;
+  }
+  BitReader reader;
+  bit_reader_init(&reader, -1, src + sizeof(header) + 4,
+                  size - sizeof(header) - 4);
+  if (table_decode(t, &reader, dst, header.file_size) != header.file_size) {
+    return -1;
+  }
+  return header.file_size;
+}
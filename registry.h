@@ -0,0 +1,36 @@
+#pragma once
+
+#include "code.h"
+#include "defines.h"
+#include "table.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Registry Registry;
+
+Registry *registry_create(void);
+
+void registry_delete(Registry **r);
+
+bool train_lengths(uint64_t hist[static ALPHABET],
+                   uint8_t lengths[static ALPHABET]);
+
+bool registry_add(Registry *r, uint8_t lengths[static ALPHABET],
+                  uint32_t *id);
+
+bool registry_save(uint8_t lengths[static ALPHABET], const char *path,
+                   uint32_t *id);
+
+bool registry_load(Registry *r, const char *path, uint32_t *id);
+
+PackedCode *registry_codes(Registry *r, uint32_t id);
+
+DecodeTable *registry_decoder(Registry *r, uint32_t id);
+
+uint64_t registry_bound(uint64_t nbytes);
+
+int64_t registry_compress(Registry *r, uint32_t id, uint8_t *src,
+                          uint64_t nbytes, uint8_t *dst, uint64_t capacity);
+
+int64_t registry_decompress(Registry *r, uint8_t *src, uint64_t size,
+                            uint8_t *dst, uint64_t capacity);
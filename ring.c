@@ -0,0 +1,555 @@
+#include "ring.h"
+#include "io.h"
+#include "stats.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// io_uring where the kernel has it, otherwise, or when built with
+// -DRING_THREADS, a reader thread and a writer thread
+#if defined(__linux__) && !defined(RING_THREADS)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define RING_URING
+#endif
+
+typedef struct Queue Queue;
+
+// one read or write of a whole buffer, resumed after short transfers
+typedef struct {
+  Queue *queue;
+  uint8_t *buf;
+  uint32_t nbytes; // bytes to move
+  uint32_t done;   // bytes moved so far
+  uint64_t offset; // file offset of buf when the file is seekable
+  bool issued;     // being moved by io_uring
+  bool finished;   // all moved, the end of infile or an error
+  bool failed;
+} Op;
+
+// the reads or the writes of a Ring, in file order, op i in
+// ops[i % capacity]
+struct Queue {
+  Ring *ring;
+  int fd;
+  bool write;
+  bool seekable;     // many ops may move at once, each at its own offset
+  uint64_t offset;   // file offset of the next op
+  uint32_t capacity;
+  uint32_t inflight; // ops io_uring is moving
+  uint64_t head;     // oldest op not yet retired
+  uint64_t next;     // next op for the thread
+  uint64_t tail;     // next op to queue
+  Op *ops;
+  pthread_t thread;
+  bool running;
+};
+
+// defines ring struct: pieces of infile read ahead into buffers of its own,
+// and buffers of its own written to outfile behind the caller, so that the
+// caller codes while both files move
+struct Ring {
+  Queue in;
+  Queue out;
+  uint32_t in_size;
+  uint64_t taken; // pieces of infile handed out, released from in.head
+  bool eof;
+  bool failed;
+  uint8_t **spare; // output buffers free for the caller
+  uint32_t spares;
+  uint8_t *memory; // every buffer
+
+  pthread_mutex_t lock;
+  pthread_cond_t queued; // broadcast when an op is queued or on shutdown
+  pthread_cond_t moved;  // broadcast when the thread finishes an op
+  bool stop;
+
+  int fd; // io_uring, -1 when the threads move the data
+#ifdef RING_URING
+  uint8_t *sq_map;
+  uint8_t *cq_map;
+  size_t sq_size;
+  size_t cq_size;
+  size_t sqes_size;
+  uint32_t *sq_tail;
+  uint32_t *sq_mask;
+  uint32_t *sq_array;
+  struct io_uring_sqe *sqes;
+  uint32_t *cq_head;
+  uint32_t *cq_tail;
+  uint32_t *cq_mask;
+  struct io_uring_cqe *cqes;
+#endif
+};
+
+#ifdef RING_URING
+// takes in ring, number of entries
+// sets up an io_uring of at least entries and maps its queues
+// returns boolean if the kernel allows io_uring
+static bool uring_setup(Ring *r, uint32_t entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  r->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (r->fd < 0) {
+    r->fd = -1;
+    return false;
+  }
+  if (!(p.features & IORING_FEAT_RW_CUR_POS)) { // no IORING_OP_READ either
+    return false;
+  }
+  r->sq_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+  r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sq_map = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  r->cq_map = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+  r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED ||
+      r->sqes == MAP_FAILED) {
+    return false;
+  }
+  r->sq_tail = (uint32_t *)(r->sq_map + p.sq_off.tail);
+  r->sq_mask = (uint32_t *)(r->sq_map + p.sq_off.ring_mask);
+  r->sq_array = (uint32_t *)(r->sq_map + p.sq_off.array);
+  r->cq_head = (uint32_t *)(r->cq_map + p.cq_off.head);
+  r->cq_tail = (uint32_t *)(r->cq_map + p.cq_off.tail);
+  r->cq_mask = (uint32_t *)(r->cq_map + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *)(r->cq_map + p.cq_off.cqes);
+  return true;
+}
+
+// takes in ring
+// unmaps and closes the io_uring
+static void uring_teardown(Ring *r) {
+  if (r->sq_map && r->sq_map != MAP_FAILED) {
+    munmap(r->sq_map, r->sq_size);
+  }
+  if (r->cq_map && r->cq_map != MAP_FAILED) {
+    munmap(r->cq_map, r->cq_size);
+  }
+  if (r->sqes && r->sqes != MAP_FAILED) {
+    munmap(r->sqes, r->sqes_size);
+  }
+  if (r->fd >= 0) {
+    close(r->fd);
+  }
+  r->fd = -1;
+}
+
+// takes in ring, op
+// submits the rest of op to io_uring
+static void uring_issue(Ring *r, Op *op) {
+  Queue *q = op->queue;
+  uint32_t tail = *r->sq_tail;
+  uint32_t index = tail & *r->sq_mask;
+  struct io_uring_sqe *sqe = &r->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = q->write ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe->fd = q->fd;
+  sqe->addr = (uint64_t)(uintptr_t)(op->buf + op->done);
+  sqe->len = op->nbytes - op->done;
+  sqe->off = q->seekable ? op->offset + op->done : (uint64_t)-1;
+  sqe->user_data = (uint64_t)(uintptr_t)op;
+  r->sq_array[index] = index;
+  __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  int ret;
+  do {
+    ret = syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0);
+  } while (ret < 0 && errno == EINTR);
+  if (ret < 0) {
+    op->failed = true;
+    op->finished = true;
+    return;
+  }
+  op->issued = true;
+  q->inflight += 1;
+}
+
+// takes in ring, op
+// asks io_uring to cancel op, which still completes through the queue
+static void uring_cancel(Ring *r, Op *op) {
+  uint32_t tail = *r->sq_tail;
+  uint32_t index = tail & *r->sq_mask;
+  struct io_uring_sqe *sqe = &r->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = (uint64_t)(uintptr_t)op;
+  sqe->user_data = 0; // its own completion is passed over
+  r->sq_array[index] = index;
+  __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  int ret;
+  do {
+    ret = syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0);
+  } while (ret < 0 && errno == EINTR);
+}
+
+// takes in ring, queue
+// submits the ops of q waiting to move: all of them when q is seekable, and
+// otherwise the oldest alone, so that a pipe moves in order
+static void uring_pump(Ring *r, Queue *q) {
+  for (uint64_t i = q->head; i < q->tail; i += 1) {
+    Op *op = &q->ops[i % q->capacity];
+    if (op->finished) {
+      continue;
+    }
+    if (!op->issued) {
+      uring_issue(r, op);
+    }
+    if (!q->seekable) {
+      break;
+    }
+  }
+}
+
+// takes in ring
+// waits for io_uring to complete at least one op, resubmitting short
+// transfers unless the ring is shutting down
+// returns boolean if io_uring could be waited on
+static bool uring_reap(Ring *r) {
+  uint32_t head = *r->cq_head;
+  while (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+    int ret = syscall(__NR_io_uring_enter, r->fd, 0, 1,
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret < 0 && errno != EINTR) {
+      r->failed = true;
+      return false;
+    }
+  }
+  for (; head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE); head += 1) {
+    struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+    Op *op = (Op *)(uintptr_t)cqe->user_data;
+    int32_t res = cqe->res;
+    if (!op) { // completion of uring_cancel()
+      continue;
+    }
+    op->issued = false;
+    op->queue->inflight -= 1;
+    if (res == -EINTR || res == -EAGAIN) {
+      continue; // submitted again below
+    }
+    if (op->queue->write) {
+      write_calls += 1;
+      write_call_bytes += res > 0 ? res : 0;
+      bytes_written += res > 0 ? res : 0;
+    } else {
+      read_calls += 1;
+      read_call_bytes += res > 0 ? res : 0;
+      bytes_read += res > 0 ? res : 0;
+    }
+    if (res < 0 || (res == 0 && op->queue->write)) {
+      op->failed = true;
+      op->finished = true;
+    } else {
+      op->done += res;
+      op->finished = res == 0 || op->done == op->nbytes;
+    }
+  }
+  __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+  if (!r->stop) {
+    uring_pump(r, &r->in);
+    uring_pump(r, &r->out);
+  }
+  return true;
+}
+#endif
+
+// takes in queue
+// moves the ops of q in order with blocking reads or writes until the ring
+// shuts down
+static void *ring_thread(void *arg) {
+  Queue *q = (Queue *)arg;
+  Ring *r = q->ring;
+  pthread_mutex_lock(&r->lock);
+  while (true) {
+    while (!r->stop && q->next == q->tail) {
+      pthread_cond_wait(&r->queued, &r->lock);
+    }
+    if (r->stop) {
+      break;
+    }
+    Op *op = &q->ops[q->next % q->capacity];
+    pthread_mutex_unlock(&r->lock);
+    int moved = q->write ? write_bytes(q->fd, op->buf, op->nbytes)
+                         : read_bytes(q->fd, op->buf, op->nbytes);
+    pthread_mutex_lock(&r->lock);
+    op->done = moved;
+    op->failed = q->write && op->done != op->nbytes;
+    op->finished = true;
+    q->next += 1;
+    pthread_cond_broadcast(&r->moved);
+  }
+  pthread_mutex_unlock(&r->lock);
+  return NULL;
+}
+
+// takes in ring, queue, buffer, number of bytes
+// queues a move of nbytes between buf and the next part of the file of q
+static void ring_queue(Ring *r, Queue *q, uint8_t *buf, uint32_t nbytes) {
+  pthread_mutex_lock(&r->lock);
+  Op *op = &q->ops[q->tail % q->capacity];
+  op->queue = q;
+  op->buf = buf;
+  op->nbytes = nbytes;
+  op->done = 0;
+  op->offset = q->offset;
+  op->issued = false;
+  op->finished = false;
+  op->failed = false;
+  q->offset += nbytes;
+  q->tail += 1;
+  pthread_cond_broadcast(&r->queued);
+  pthread_mutex_unlock(&r->lock);
+#ifdef RING_URING
+  if (r->fd >= 0) {
+    uring_pump(r, q);
+  }
+#endif
+}
+
+// takes in ring, op
+// waits for op to finish
+static void ring_wait(Ring *r, Op *op) {
+  uint32_t phase = stats_phase(PHASE_IO);
+#ifdef RING_URING
+  while (r->fd >= 0 && !op->finished && !r->failed) {
+    uring_reap(r);
+  }
+  if (r->fd >= 0 && !op->finished) {
+    op->failed = true;
+    op->finished = true;
+  }
+#endif
+  pthread_mutex_lock(&r->lock);
+  while (!op->finished) {
+    pthread_cond_wait(&r->moved, &r->lock);
+  }
+  pthread_mutex_unlock(&r->lock);
+  stats_phase(phase);
+}
+
+// takes in ring
+// queues reads into every free input buffer until the end of infile
+static void ring_fill(Ring *r) {
+  while (r->in.fd >= 0 && !r->eof && r->in.tail - r->in.head < r->in.capacity) {
+    uint32_t slot = r->in.tail % r->in.capacity;
+    ring_queue(r, &r->in, r->memory + (uint64_t)slot * r->in_size,
+               r->in_size);
+  }
+}
+
+// takes in descriptor, whether the queue writes, capacity
+// returns queue over fd, seekable when it is a regular file or block device
+static Queue queue_init(int fd, bool write, uint32_t capacity) {
+  Queue q;
+  struct stat stats;
+  memset(&q, 0, sizeof(q));
+  q.fd = fd;
+  q.write = write;
+  q.capacity = capacity;
+  if (fd >= 0 && fstat(fd, &stats) == 0 &&
+      (S_ISREG(stats.st_mode) || S_ISBLK(stats.st_mode))) {
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    q.seekable = offset != -1;
+    q.offset = offset != -1 ? offset : 0;
+  }
+  return q;
+}
+
+// takes in infile descriptor or -1, outfile descriptor, size of the pieces
+// of infile, size of the output buffers, number of buffers of each kind the
+// caller may hold at once, number more of each kind to keep moving
+// constructor for ring, reading infile ahead in pieces of in_size bytes and
+// writing to outfile behind, with ahead buffers of each kind moving while
+// the caller holds its own
+// returns ring
+Ring *ring_create(int infile, int outfile, uint32_t in_size,
+                  uint32_t out_size, uint32_t held, uint32_t ahead) {
+  Ring *r = (Ring *)calloc(1, sizeof(Ring));
+  if (!r) {
+    return NULL;
+  }
+  uint32_t buffers = held + ahead;
+  r->fd = -1;
+  r->in_size = infile >= 0 ? in_size : 0;
+  r->in = queue_init(infile, false, buffers);
+  r->out = queue_init(outfile, true, buffers);
+  r->in.ring = r;
+  r->out.ring = r;
+  r->in.ops = (Op *)calloc(buffers, sizeof(Op));
+  r->out.ops = (Op *)calloc(buffers, sizeof(Op));
+  r->spare = (uint8_t **)malloc(buffers * sizeof(uint8_t *));
+  r->memory = (uint8_t *)malloc((uint64_t)buffers * (r->in_size + out_size));
+  pthread_mutex_init(&r->lock, NULL);
+  pthread_cond_init(&r->queued, NULL);
+  pthread_cond_init(&r->moved, NULL);
+  if (!r->in.ops || !r->out.ops || !r->spare || !r->memory) {
+    ring_delete(&r);
+    return NULL;
+  }
+  for (uint32_t i = 0; i < buffers; i += 1) {
+    r->spare[i] = r->memory + (uint64_t)buffers * r->in_size +
+                  (uint64_t)i * out_size;
+  }
+  r->spares = buffers;
+
+#ifdef RING_URING
+  if (!uring_setup(r, 2 * buffers)) {
+    uring_teardown(r);
+  }
+#endif
+  if (r->fd == -1) {
+    r->in.running =
+        infile >= 0 && pthread_create(&r->in.thread, NULL, ring_thread,
+                                      &r->in) == 0;
+    r->out.running =
+        pthread_create(&r->out.thread, NULL, ring_thread, &r->out) == 0;
+    if ((infile >= 0 && !r->in.running) || !r->out.running) {
+      ring_delete(&r);
+      return NULL;
+    }
+  }
+  ring_fill(r);
+  return r;
+}
+
+// takes in double pointer to ring
+// destructor for ring, cancelling reads and writes still moving and waiting
+// for io_uring to hand back their buffers
+void ring_delete(Ring **r) {
+  if (*r) {
+    pthread_mutex_lock(&(*r)->lock);
+    (*r)->stop = true;
+    pthread_cond_broadcast(&(*r)->queued);
+    pthread_mutex_unlock(&(*r)->lock);
+    if ((*r)->in.running) {
+      pthread_join((*r)->in.thread, NULL);
+    }
+    if ((*r)->out.running) {
+      pthread_join((*r)->out.thread, NULL);
+    }
+#ifdef RING_URING
+    // the kernel must be done with the buffers before they are freed, so
+    // they are leaked if io_uring cannot be waited on
+    Queue *queues[] = {&(*r)->in, &(*r)->out};
+    for (uint32_t i = 0; (*r)->fd >= 0 && i < 2; i += 1) {
+      for (uint64_t j = queues[i]->head; j < queues[i]->tail; j += 1) {
+        Op *op = &queues[i]->ops[j % queues[i]->capacity];
+        if (op->issued) {
+          uring_cancel(*r, op);
+        }
+      }
+    }
+    bool drained = true;
+    while (drained && (*r)->fd >= 0 &&
+           (*r)->in.inflight + (*r)->out.inflight > 0) {
+      drained = uring_reap(*r);
+    }
+    uring_teardown(*r);
+    if (!drained) {
+      (*r)->memory = NULL;
+    }
+#endif
+    pthread_mutex_destroy(&(*r)->lock);
+    pthread_cond_destroy(&(*r)->queued);
+    pthread_cond_destroy(&(*r)->moved);
+    free((*r)->in.ops);
+    free((*r)->out.ops);
+    free((*r)->spare);
+    free((*r)->memory);
+    free(*r);
+    *r = NULL;
+  }
+}
+
+// takes in ring, pointer for the buffer
+// takes the next piece of infile, which stays valid until ring_release()
+// returns the bytes in the piece, fewer than the piece size only at the end
+// of infile, 0 after it and -1 on a read error
+int64_t ring_read(Ring *r, uint8_t **buf) {
+  if (r->taken == r->in.tail) {
+    return 0;
+  }
+  Op *op = &r->in.ops[r->taken % r->in.capacity];
+  ring_wait(r, op);
+  if (op->failed) {
+    return -1;
+  }
+  r->eof = r->eof || op->done < op->nbytes;
+  if (op->done == 0) {
+    return 0;
+  }
+  r->taken += 1;
+  *buf = op->buf;
+  return op->done;
+}
+
+// takes in ring
+// gives back the oldest piece taken with ring_read() to be read into again
+void ring_release(Ring *r) {
+  if (r->in.head < r->taken) {
+    r->in.head += 1;
+    ring_fill(r);
+  }
+}
+
+// takes in ring
+// waits for the oldest write and frees its buffer
+static void ring_retire(Ring *r) {
+  Op *op = &r->out.ops[r->out.head % r->out.capacity];
+  ring_wait(r, op);
+  r->failed = r->failed || op->failed;
+  r->spare[r->spares] = op->buf;
+  r->spares += 1;
+  r->out.head += 1;
+}
+
+// takes in ring
+// returns a free output buffer, waiting for a write to finish if there is
+// none, NULL if the caller holds every buffer
+uint8_t *ring_buffer(Ring *r) {
+  if (r->spares == 0 && r->out.head < r->out.tail) {
+    ring_retire(r);
+  }
+  if (r->spares == 0) {
+    return NULL;
+  }
+  r->spares -= 1;
+  return r->spare[r->spares];
+}
+
+// takes in ring, buffer from ring_buffer(), number of bytes
+// writes nbytes of buf to outfile after everything written before it, and
+// takes buf back once written, at once when outfile is -1
+// returns boolean if every write so far succeeded
+bool ring_write(Ring *r, uint8_t *buf, uint32_t nbytes) {
+  if (nbytes == 0 || r->out.fd == -1) {
+    bytes_written += nbytes;
+    r->spare[r->spares] = buf;
+    r->spares += 1;
+  } else {
+    ring_queue(r, &r->out, buf, nbytes);
+  }
+  return !r->failed;
+}
+
+// takes in ring
+// waits for every write, leaving outfile positioned after them for the
+// caller to write on
+// returns boolean if every write succeeded
+bool ring_finish(Ring *r) {
+  while (r->out.head < r->out.tail) {
+    ring_retire(r);
+  }
+  if (r->fd >= 0 && r->out.seekable) {
+    lseek(r->out.fd, r->out.offset, SEEK_SET);
+  }
+  return !r->failed;
+}
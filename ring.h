@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Ring Ring;
+
+Ring *ring_create(int infile, int outfile, uint32_t in_size,
+                  uint32_t out_size, uint32_t held, uint32_t ahead);
+
+void ring_delete(Ring **r);
+
+int64_t ring_read(Ring *r, uint8_t **buf);
+
+void ring_release(Ring *r);
+
+uint8_t *ring_buffer(Ring *r);
+
+bool ring_write(Ring *r, uint8_t *buf, uint32_t nbytes);
+
+bool ring_finish(Ring *r);
@@ -0,0 +1,200 @@
+#include "stats.h"
+#include "io.h"
+
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define COUNTERS 3 // cycles, instructions and branch misses
+
+static const char *phase_names[PHASES] = {
+    "other", "histogram", "tree", "codes", "header", "coding", "io"};
+
+static const char *counter_names[COUNTERS] = {"cycles", "instructions",
+                                              "branch_misses"};
+
+// time and hardware counters spent in each phase by the thread that called
+// stats_start, other threads of the pool only show up as coding time spent
+// waiting on them
+static struct {
+  uint64_t ns[PHASES];
+  uint64_t entries[PHASES];
+  uint64_t counts[PHASES][COUNTERS];
+  uint64_t since_ns;          // start of the current phase
+  uint64_t since[COUNTERS];   // counters at the start of the current phase
+  uint32_t phase;             // current phase
+  int group;                  // perf event group leader, -1 if unavailable
+  int fds[COUNTERS];          // perf event of each counter, -1 if unavailable
+  int slots[COUNTERS];        // position of each counter in a group read, -1
+  uint32_t opened;            // number of counters in the group
+} stats = {.group = -1};
+
+static _Thread_local bool tracing = false; // true on the thread measured
+
+// returns the current time in nanoseconds
+static uint64_t now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// takes in hardware event, group leader or -1
+// opens a user space counter of event on the calling thread
+// returns the perf event descriptor, -1 if the kernel or sandbox refuses
+static int open_counter(uint64_t event, int group) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = event;
+  attr.disabled = group == -1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+// takes in array for the counter values
+// reads every counter of the group in one call
+static void read_counters(uint64_t values[static COUNTERS]) {
+  uint64_t group[1 + COUNTERS] = {0};
+  memset(values, 0, COUNTERS * sizeof(uint64_t));
+  if (stats.group == -1 ||
+      read(stats.group, group, (1 + stats.opened) * sizeof(uint64_t)) <= 0) {
+    return;
+  }
+  for (uint32_t i = 0; i < COUNTERS; i += 1) {
+    values[i] = stats.slots[i] >= 0 ? group[1 + stats.slots[i]] : 0;
+  }
+}
+
+// starts timing phases on the calling thread, with hardware counters where
+// perf_event_open is permitted
+void stats_start(void) {
+  static const uint64_t events[COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES,
+                                            PERF_COUNT_HW_INSTRUCTIONS,
+                                            PERF_COUNT_HW_BRANCH_MISSES};
+  for (uint32_t i = 0; i < COUNTERS; i += 1) {
+    int fd = open_counter(events[i], stats.group);
+    stats.fds[i] = fd;
+    stats.slots[i] = fd >= 0 ? (int)stats.opened : -1;
+    stats.opened += fd >= 0;
+    stats.group = stats.group == -1 ? fd : stats.group;
+  }
+  if (stats.group != -1) {
+    ioctl(stats.group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+  tracing = true;
+  stats.phase = PHASE_OTHER;
+  stats.since_ns = now_ns();
+  read_counters(stats.since);
+}
+
+// takes in phase
+// charges the time since the last switch to the current phase and makes
+// phase current, a no-op on threads other than the one measured
+// returns the phase that was current, to switch back to
+uint32_t stats_phase(uint32_t phase) {
+  if (!tracing) {
+    return phase;
+  }
+  uint64_t t = now_ns();
+  uint64_t counts[COUNTERS];
+  read_counters(counts);
+  uint32_t previous = stats.phase;
+  stats.ns[previous] += t - stats.since_ns;
+  for (uint32_t i = 0; i < COUNTERS; i += 1) {
+    stats.counts[previous][i] += counts[i] - stats.since[i];
+    stats.since[i] = counts[i];
+  }
+  // returning from a read or write does not enter the phase again
+  stats.entries[phase] += phase != previous &&
+                          (phase == PHASE_IO || previous != PHASE_IO);
+  stats.since_ns = t;
+  stats.phase = phase;
+  return previous;
+}
+
+// stops timing phases, charging the time so far to the current phase
+void stats_stop(void) {
+  if (!tracing) {
+    return;
+  }
+  stats_phase(PHASE_OTHER);
+  tracing = false;
+  for (uint32_t i = 0; i < COUNTERS; i += 1) {
+    if (stats.fds[i] >= 0) {
+      close(stats.fds[i]);
+    }
+  }
+  stats.group = -1;
+}
+
+// takes in uncompressed size, compressed size, whether to print JSON
+// prints the time and counters of each phase and the system calls made, and
+// in JSON the sizes as well
+void stats_print(uint64_t uncompressed, uint64_t compressed, bool json) {
+  uint64_t total = 0;
+  for (uint32_t p = 0; p < PHASES; p += 1) {
+    total += stats.ns[p];
+  }
+  uint64_t reads = read_calls;
+  uint64_t writes = write_calls;
+  uint64_t in = read_call_bytes;
+  uint64_t out = write_call_bytes;
+  if (json) {
+    fprintf(stderr,
+            "{\"uncompressed\": %" PRIu64 ", \"compressed\": %" PRIu64
+            ", \"seconds\": %.6f, \"phases\": {",
+            uncompressed, compressed, total / 1e9);
+    for (uint32_t p = 0; p < PHASES; p += 1) {
+      fprintf(stderr, "%s\"%s\": {\"seconds\": %.6f, \"entries\": %" PRIu64,
+              p ? ", " : "", phase_names[p], stats.ns[p] / 1e9,
+              stats.entries[p]);
+      for (uint32_t i = 0; i < COUNTERS; i += 1) {
+        if (stats.slots[i] >= 0) {
+          fprintf(stderr, ", \"%s\": %" PRIu64, counter_names[i],
+                  stats.counts[p][i]);
+        }
+      }
+      fprintf(stderr, "}");
+    }
+    fprintf(stderr,
+            "}, \"syscalls\": {\"read\": %" PRIu64 ", \"write\": %" PRIu64
+            ", \"read_bytes\": %" PRIu64 ", \"write_bytes\": %" PRIu64
+            "}, \"counters\": %s}\n",
+            reads, writes, in, out, stats.opened ? "true" : "false");
+    return;
+  }
+  fprintf(stderr, "%-10s %10s %6s %8s", "Phase", "ms", "%", "entries");
+  for (uint32_t i = 0; i < COUNTERS; i += 1) {
+    if (stats.slots[i] >= 0) {
+      fprintf(stderr, " %14s", counter_names[i]);
+    }
+  }
+  fprintf(stderr, "\n");
+  for (uint32_t p = 0; p < PHASES; p += 1) {
+    fprintf(stderr, "%-10s %10.3f %6.1f %8" PRIu64, phase_names[p],
+            stats.ns[p] / 1e6, total ? 100.0 * stats.ns[p] / total : 0.0,
+            stats.entries[p]);
+    for (uint32_t i = 0; i < COUNTERS; i += 1) {
+      if (stats.slots[i] >= 0) {
+        fprintf(stderr, " %14" PRIu64, stats.counts[p][i]);
+      }
+    }
+    fprintf(stderr, "\n");
+  }
+  if (!stats.opened) {
+    fprintf(stderr, "Hardware counters: unavailable\n");
+  }
+  fprintf(stderr,
+          "Read calls: %" PRIu64 ", %.0f bytes per call\n"
+          "Write calls: %" PRIu64 ", %.0f bytes per call\n",
+          reads, reads ? (double)in / reads : 0.0, writes,
+          writes ? (double)out / writes : 0.0);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PHASE_OTHER 0     // anything outside the phases below
+#define PHASE_HISTOGRAM 1 // counting symbols
+#define PHASE_TREE 2      // building or rebuilding the Huffman tree
+#define PHASE_CODES 3     // code lengths, codes and decode tables
+#define PHASE_HEADER 4    // header, tree dump, code lengths and index
+#define PHASE_CODING 5    // coding the bitstream or waiting on coder threads
+#define PHASE_IO 6        // inside read and write system calls
+#define PHASES 7
+
+void stats_start(void);
+
+uint32_t stats_phase(uint32_t phase);
+
+void stats_stop(void);
+
+void stats_print(uint64_t uncompressed, uint64_t compressed, bool json);
@@ -0,0 +1,293 @@
+#include "stream.h"
+#include "block.h"
+#include "header.h"
+#include <stdlib.h>
+#include <string.h>
+
+// streaming encoder state, all of it owned by the context so that any number
+// of them can run at once
+struct Encoder {
+  uint32_t block_size;
+  uint32_t limit;   // maximum code length or 0
+  uint32_t streams; // bitstreams per block
+  bool finished;    // end of the stream queued
+  bool failed;
+  uint8_t *in;
+  uint32_t in_size; // bytes of the next block buffered in in
+  uint8_t *out;
+  uint32_t out_start; // next byte to pull
+  uint32_t out_end;   // end of the pending output
+  uint32_t capacity;  // size of out
+};
+
+// streaming decoder state, see Encoder
+struct Decoder {
+  Header header;
+  BlockHeader block;
+  bool started;   // header read
+  bool payload;   // reading the compressed block after block
+  bool done;      // all blocks decoded
+  bool failed;
+  uint64_t remaining; // bytes left to decode, UINT64_MAX until the end block
+  uint8_t *in;
+  uint32_t in_capacity;
+  uint32_t have; // bytes of the next header or block in in
+  uint32_t need; // bytes needed to complete it
+  uint8_t *out;
+  uint32_t out_capacity;
+  uint32_t out_start; // next byte to pull
+  uint32_t out_end;   // end of the pending output
+};
+
+// takes in block size, maximum code length or 0, number of bitstreams per
+// block
+// constructor for Encoder, writing the streamed block format read by decode
+// returns Encoder, NULL if the arguments are out of range
+Encoder *encoder_create(uint32_t block_size, uint32_t limit, uint32_t streams) {
+  if (block_size < BLOCK || block_size > MAX_BLOCK_SIZE ||
+      limit > MAX_PACKED_BITS || streams == 0 || streams > MAX_STREAMS) {
+    return NULL;
+  }
+  Encoder *e = (Encoder *)calloc(1, sizeof(Encoder));
+  if (!e) {
+    return NULL;
+  }
+  e->block_size = block_size;
+  e->limit = limit;
+  e->streams = streams;
+  // room for the header, two coded blocks and the end block
+  e->capacity = sizeof(Header) +
+                2 * (sizeof(BlockHeader) + block_bound(block_size)) +
+                sizeof(BlockHeader);
+  e->in = (uint8_t *)malloc(block_size);
+  e->out = (uint8_t *)malloc(e->capacity);
+  if (!e->in || !e->out) {
+    encoder_delete(&e);
+    return NULL;
+  }
+  Header header;
+  header.magic = MAGIC_VERSIONED;
+  header.permissions = 0600;
+  header.version = VERSION_BLOCKS;
+  header.flags = FLAG_STREAMED | (streams > 1 ? FLAG_STREAMS : 0);
+  header.file_size = 0;
+  memcpy(e->out, &header, sizeof(header));
+  e->out_end = sizeof(header);
+  return e;
+}
+
+// takes in double pointer to Encoder
+// destructor for Encoder
+void encoder_delete(Encoder **e) {
+  if (*e) {
+    free((*e)->in);
+    free((*e)->out);
+    free(*e);
+    *e = NULL;
+  }
+}
+
+// takes in Encoder
+// codes the buffered block into the output once there is room for it
+// returns boolean if the block was coded
+static bool code_block(Encoder *e) {
+  if (e->out_start > 0) { // move the pending output to the front
+    memmove(e->out, e->out + e->out_start, e->out_end - e->out_start);
+    e->out_end -= e->out_start;
+    e->out_start = 0;
+  }
+  if (e->out_end + 2 * sizeof(BlockHeader) + block_bound(e->block_size) >
+      e->capacity) {
+    return false;
+  }
+  uint64_t bits = 0;
+  BlockHeader block = {e->in_size, 0};
+  block.size = encode_block(e->in, e->in_size, e->out + e->out_end +
+                            sizeof(block), e->limit, e->streams, false,
+                            &bits);
+  if (block.size == 0) {
+    e->failed = true;
+    return false;
+  }
+  memcpy(e->out + e->out_end, &block, sizeof(block));
+  e->out_end += sizeof(block) + block.size;
+  e->in_size = 0;
+  return true;
+}
+
+// takes in Encoder, source buffer of nbytes
+// buffers src and codes each block as it fills, taking no more input while
+// the output is too full for the next block
+// returns the number of bytes taken from src, -1 on failure
+int encoder_push(Encoder *e, uint8_t *src, int nbytes) {
+  int consumed = 0;
+  while (!e->failed && !e->finished) {
+    uint32_t n = e->block_size - e->in_size;
+    n = (uint32_t)(nbytes - consumed) < n ? (uint32_t)(nbytes - consumed) : n;
+    memcpy(e->in + e->in_size, src + consumed, n);
+    e->in_size += n;
+    consumed += n;
+    if ((e->in_size == e->block_size && !code_block(e)) ||
+        consumed == nbytes) {
+      break;
+    }
+  }
+  return e->failed || e->finished ? -1 : consumed;
+}
+
+// takes in Encoder
+// ends the input, coding the last block and the end block that follows it
+// returns boolean if the end of the stream is queued, false until enough
+// output has been pulled to make room for them or after a failure
+bool encoder_finish(Encoder *e) {
+  if (!e->finished && !e->failed && (e->in_size == 0 || code_block(e))) {
+    BlockHeader end = {0, 0};
+    memcpy(e->out + e->out_end, &end, sizeof(end));
+    e->out_end += sizeof(end);
+    e->finished = true;
+  }
+  return e->finished;
+}
+
+// takes in Encoder, destination buffer of capacity bytes
+// copies out pending compressed bytes
+// returns the number of bytes stored in dst
+int encoder_pull(Encoder *e, uint8_t *dst, int capacity) {
+  uint32_t n = e->out_end - e->out_start;
+  n = (uint32_t)capacity < n ? (uint32_t)capacity : n;
+  memcpy(dst, e->out + e->out_start, n);
+  e->out_start += n;
+  return n;
+}
+
+// constructor for Decoder
+// returns Decoder
+Decoder *decoder_create(void) {
+  Decoder *d = (Decoder *)calloc(1, sizeof(Decoder));
+  if (!d) {
+    return NULL;
+  }
+  d->in_capacity = sizeof(Header);
+  d->in = (uint8_t *)malloc(d->in_capacity);
+  if (!d->in) {
+    decoder_delete(&d);
+    return NULL;
+  }
+  d->need = sizeof(Header);
+  return d;
+}
+
+// takes in double pointer to Decoder
+// destructor for Decoder
+void decoder_delete(Decoder **d) {
+  if (*d) {
+    free((*d)->in);
+    free((*d)->out);
+    free(*d);
+    *d = NULL;
+  }
+}
+
+// takes in Decoder
+// checks the block header in in and makes room for the block
+// returns boolean if the block header is valid
+static bool start_block(Decoder *d) {
+  BlockHeader *b = &d->block;
+  memcpy(b, d->in, sizeof(*b));
+  if ((d->header.flags & FLAG_STREAMED) && b->raw_size == 0 && b->size == 0) {
+    d->done = true; // end of a stream of unknown size
+    return true;
+  }
+  if (b->raw_size == 0 || b->raw_size > MAX_BLOCK_SIZE ||
+      b->raw_size > d->remaining || b->size > block_bound(b->raw_size)) {
+    return false;
+  }
+  if (b->size > d->in_capacity) { // grow the block buffers
+    free(d->in);
+    d->in_capacity = block_bound(b->raw_size);
+    d->in = (uint8_t *)malloc(d->in_capacity);
+  }
+  if (b->raw_size > d->out_capacity) {
+    free(d->out);
+    d->out_capacity = b->raw_size;
+    d->out = (uint8_t *)malloc(d->out_capacity);
+  }
+  d->payload = true;
+  d->need = b->size;
+  return d->in && d->out;
+}
+
+// takes in Decoder
+// acts on the header, block header or block completed in in
+// returns boolean if it was valid
+static bool step(Decoder *d) {
+  if (!d->started) {
+    memcpy(&d->header, d->in, sizeof(Header));
+    if (d->header.magic != MAGIC_VERSIONED ||
+        d->header.version != VERSION_BLOCKS) {
+      return false;
+    }
+    d->started = true;
+    d->remaining = d->header.flags & FLAG_STREAMED ? UINT64_MAX
+                                                   : d->header.file_size;
+    d->done = d->remaining == 0;
+    d->need = sizeof(BlockHeader);
+    return true;
+  }
+  if (!d->payload) {
+    return start_block(d);
+  }
+  if (!decode_block(d->in, d->block.size, d->out, d->block.raw_size,
+                    d->header.flags)) {
+    return false;
+  }
+  d->out_start = 0;
+  d->out_end = d->block.raw_size;
+  d->remaining -= d->block.raw_size;
+  d->done = d->remaining == 0;
+  d->payload = false;
+  d->need = sizeof(BlockHeader);
+  return true;
+}
+
+// takes in Decoder, source buffer of nbytes
+// buffers src and decodes each block as it completes, taking no more input
+// while a decoded block is still to be pulled or once all blocks are decoded
+// returns the number of bytes taken from src, -1 if src is not a valid
+// stream of blocks
+int decoder_push(Decoder *d, uint8_t *src, int nbytes) {
+  int consumed = 0;
+  while (!d->failed && !d->done && d->out_start == d->out_end &&
+         consumed < nbytes) {
+    uint32_t n = d->need - d->have;
+    n = (uint32_t)(nbytes - consumed) < n ? (uint32_t)(nbytes - consumed) : n;
+    memcpy(d->in + d->have, src + consumed, n);
+    d->have += n;
+    consumed += n;
+    if (d->have == d->need) {
+      d->have = 0;
+      d->failed = !step(d);
+    }
+  }
+  return d->failed ? -1 : consumed;
+}
+
+// takes in Decoder, destination buffer of capacity bytes
+// copies out pending decompressed bytes
+// returns the number of bytes stored in dst
+int decoder_pull(Decoder *d, uint8_t *dst, int capacity) {
+  uint32_t n = d->out_end - d->out_start;
+  n = (uint32_t)capacity < n ? (uint32_t)capacity : n;
+  if (n == 0) {
+    return 0;
+  }
+  memcpy(dst, d->out + d->out_start, n);
+  d->out_start += n;
+  return n;
+}
+
+// takes in Decoder
+// returns boolean if every block was decoded and pulled
+bool decoder_done(Decoder *d) {
+  return d->done && d->out_start == d->out_end;
+}
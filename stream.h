@@ -0,0 +1,29 @@
+#pragma once
+
+#include "defines.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Encoder Encoder;
+
+typedef struct Decoder Decoder;
+
+Encoder *encoder_create(uint32_t block_size, uint32_t limit, uint32_t streams);
+
+void encoder_delete(Encoder **e);
+
+int encoder_push(Encoder *e, uint8_t *src, int nbytes);
+
+bool encoder_finish(Encoder *e);
+
+int encoder_pull(Encoder *e, uint8_t *dst, int capacity);
+
+Decoder *decoder_create(void);
+
+void decoder_delete(Decoder **d);
+
+int decoder_push(Decoder *d, uint8_t *src, int nbytes);
+
+int decoder_pull(Decoder *d, uint8_t *dst, int capacity);
+
+bool decoder_done(Decoder *d);
@@ -0,0 +1,240 @@
+#include "table.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TABLE_MASK (TABLE_SIZE - 1)
+#define LEAF 0x8000 // marks an overflow child as a symbol instead of a node
+
+// takes in DecodeTable t, Code c, symbol
+// adds a code longer than TABLE_BITS to the overflow tree
+static void insert_long(DecodeTable *t, Code *c, uint8_t symbol) {
+  uint32_t prefix = 0;
+  for (uint32_t i = 0; i < TABLE_BITS; i += 1) {
+    prefix |= (uint32_t)code_get_bit(c, i) << i;
+  }
+  Entry *e = &t->entries[prefix];
+  if (e->next == 0) {
+    e->next = t->nodes;
+    t->nodes += 1;
+  }
+  uint16_t node = e->next;
+  for (uint32_t i = TABLE_BITS; i < code_size(c); i += 1) {
+    uint8_t bit = code_get_bit(c, i);
+    if (i == code_size(c) - 1) {
+      t->children[node][bit] = LEAF | symbol;
+    } else {
+      if (t->children[node][bit] == 0) {
+        t->children[node][bit] = t->nodes;
+        t->nodes += 1;
+      }
+      node = t->children[node][bit];
+    }
+  }
+}
+
+// takes in DecodeTable t, Code table of size ALPHABET
+// fills t in place, in storage owned by the caller, symbols with an empty
+// code are left out
+void table_init(DecodeTable *t, Code table[static ALPHABET]) {
+  memset(t, 0, sizeof(DecodeTable));
+  t->nodes = 1; // node 0 marks a missing child
+  for (uint32_t s = 0; s < ALPHABET; s += 1) {
+    uint32_t length = code_size(&table[s]);
+    if (length == 0) {
+      continue;
+    }
+    if (length > TABLE_BITS) {
+      insert_long(t, &table[s], s);
+      continue;
+    }
+    uint32_t code = 0;
+    for (uint32_t i = 0; i < length; i += 1) {
+      code |= (uint32_t)code_get_bit(&table[s], i) << i;
+    }
+    for (uint32_t i = code; i < TABLE_SIZE; i += 1 << length) {
+      t->entries[i].symbol = s;
+      t->entries[i].length = length;
+    }
+  }
+}
+
+// takes in Code table of size ALPHABET
+// constructor for decode table, symbols with an empty code are left out
+// returns decode table
+DecodeTable *table_create(Code table[static ALPHABET]) {
+  DecodeTable *t = (DecodeTable *)malloc(sizeof(DecodeTable));
+  if (t) {
+    table_init(t, table);
+  }
+  return t;
+}
+
+// takes in double pointer to decode table
+// destructor for decode table
+void table_delete(DecodeTable **t) {
+  if (*t) {
+    free(*t);
+    *t = NULL;
+  }
+}
+
+// takes in BitReader r
+// tops up the accumulator from the buffer in place, and through
+// bit_reader_refill() only once the buffer runs low
+static inline void refill(BitReader *r) {
+  if (r->size - r->index < 8) {
+    bit_reader_refill(r);
+    return;
+  }
+  while (r->count <= 56) {
+    r->bits |= (uint64_t)r->buffer[r->index] << r->count;
+    r->index += 1;
+    r->count += 8;
+  }
+}
+
+// takes in DecodeTable t, BitReader r, Entry of a long code, pointer for the
+// symbol
+// slow path, walks the rest of a code longer than TABLE_BITS
+// returns boolean if a code matched
+static bool decode_long(DecodeTable *t, BitReader *r, Entry e,
+                        uint8_t *symbol) {
+  if (e.next == 0) { // no code starts with these bits
+    return false;
+  }
+  r->bits >>= TABLE_BITS;
+  r->count -= TABLE_BITS;
+  uint16_t node = e.next;
+  while (!(node & LEAF)) {
+    if (r->count == 0) {
+      refill(r);
+    }
+    node = t->children[node][r->bits & 1];
+    r->bits >>= 1;
+    r->count -= 1;
+    if (node == 0) {
+      return false;
+    }
+  }
+  *symbol = node & 0xFF;
+  return true;
+}
+
+// takes in DecodeTable t, BitReader r, pointer for the symbol
+// decodes one symbol, resolving a code of at most TABLE_BITS bits in a single
+// lookup
+// returns boolean if a code matched
+static inline bool decode_symbol(DecodeTable *t, BitReader *r,
+                                 uint8_t *symbol) {
+  if (r->count < TABLE_BITS) {
+    refill(r);
+  }
+  Entry e = t->entries[r->bits & TABLE_MASK];
+  if (e.length) { // fast path, whole code resolved
+    *symbol = e.symbol;
+    r->bits >>= e.length;
+    r->count -= e.length;
+    return true;
+  }
+  return decode_long(t, r, e, symbol);
+}
+
+// takes in DecodeTable t, BitReader r, buffer, number of bytes
+// decodes up to nbytes symbols from r into buf
+// returns the number of symbols decoded, fewer than nbytes on a corrupt stream
+uint64_t table_decode(DecodeTable *t, BitReader *r, uint8_t *buf,
+                      uint64_t nbytes) {
+  uint64_t n = 0;
+  while (n < nbytes && decode_symbol(t, r, &buf[n])) {
+    n += 1;
+  }
+  return n;
+}
+
+// takes in DecodeTable t, array of BitReader, number of streams, buffer,
+// number of bytes
+// decodes nbytes symbols into buf, split into segments of nbytes / streams
+// symbols, rounded up, with one bitstream each; the streams advance in
+// lockstep so that their independent lookups overlap
+// returns boolean if every segment decoded
+bool table_decode_streams(DecodeTable *t, BitReader r[], uint32_t streams,
+                          uint8_t *buf, uint64_t nbytes) {
+  uint64_t segment = (nbytes + streams - 1) / streams;
+  uint64_t start[MAX_STREAMS];
+  uint64_t end[MAX_STREAMS];
+  for (uint32_t k = 0; k < streams; k += 1) {
+    start[k] = k * segment < nbytes ? k * segment : nbytes;
+    end[k] = start[k] + segment < nbytes ? start[k] + segment : nbytes;
+  }
+  uint64_t lockstep = end[streams - 1] - start[streams - 1]; // the shortest
+  bool ok = true;
+  if (streams == 4) { // unrolled for the default
+    uint8_t *out = buf + start[0];
+    for (uint64_t i = 0; ok && i < lockstep; i += 1) {
+      ok = decode_symbol(t, &r[0], &out[i]) &
+           decode_symbol(t, &r[1], &out[segment + i]) &
+           decode_symbol(t, &r[2], &out[2 * segment + i]) &
+           decode_symbol(t, &r[3], &out[3 * segment + i]);
+    }
+  } else {
+    for (uint64_t i = 0; ok && i < lockstep; i += 1) {
+      for (uint32_t k = 0; k < streams; k += 1) {
+        ok = decode_symbol(t, &r[k], &buf[start[k] + i]) && ok;
+      }
+    }
+  }
+  for (uint32_t k = 0; ok && k < streams; k += 1) { // longer segments' tails
+    uint64_t rest = end[k] - start[k] - lockstep;
+    ok = table_decode(t, &r[k], buf + start[k] + lockstep, rest) == rest;
+  }
+  return ok;
+}
+
+// takes in DecodeTable of each context group, group of each previous byte,
+// array of BitReader, number of streams, buffer, number of bytes
+// decodes nbytes symbols into buf in segments like table_decode_streams(),
+// each symbol with the table of the group of the byte before it in its
+// segment, group map[0] for the first
+// returns boolean if every segment decoded
+bool table_decode_context(DecodeTable tables[], uint8_t map[static ALPHABET],
+                          BitReader r[], uint32_t streams, uint8_t *buf,
+                          uint64_t nbytes) {
+  DecodeTable *after[ALPHABET]; // table of the group of each previous byte
+  for (uint32_t i = 0; i < ALPHABET; i += 1) {
+    after[i] = &tables[map[i]];
+  }
+  if (streams == 1) { // keep the previous byte in a register
+    uint8_t symbol = 0;
+    bool ok = true;
+    for (uint64_t i = 0; ok && i < nbytes; i += 1) {
+      ok = decode_symbol(after[symbol], &r[0], &symbol);
+      buf[i] = symbol;
+    }
+    return ok;
+  }
+  uint64_t segment = (nbytes + streams - 1) / streams;
+  uint64_t start[MAX_STREAMS];
+  uint64_t end[MAX_STREAMS];
+  uint8_t prev[MAX_STREAMS];
+  for (uint32_t k = 0; k < streams; k += 1) {
+    start[k] = k * segment < nbytes ? k * segment : nbytes;
+    end[k] = start[k] + segment < nbytes ? start[k] + segment : nbytes;
+    prev[k] = 0;
+  }
+  uint64_t lockstep = end[streams - 1] - start[streams - 1]; // the shortest
+  bool ok = true;
+  for (uint64_t i = 0; ok && i < lockstep; i += 1) {
+    for (uint32_t k = 0; k < streams; k += 1) {
+      uint8_t *out = &buf[start[k] + i];
+      ok = decode_symbol(after[prev[k]], &r[k], out) && ok;
+      prev[k] = *out;
+    }
+  }
+  for (uint32_t k = 0; ok && k < streams; k += 1) { // longer segments' tails
+    for (uint64_t i = start[k] + lockstep; ok && i < end[k]; i += 1) {
+      ok = decode_symbol(after[prev[k]], &r[k], &buf[i]);
+      prev[k] = buf[i];
+    }
+  }
+  return ok;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "code.h"
+#include "defines.h"
+#include "io.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TABLE_SIZE (1 << TABLE_BITS)
+
+// one lookup result for the next TABLE_BITS bits of the stream
+typedef struct {
+  uint8_t symbol; // decoded symbol
+  uint8_t length; // code length, 0 if the code is longer than TABLE_BITS
+  uint16_t next;  // overflow tree node continuing a long code, 0 if invalid
+} Entry;
+
+// defines decode table struct: a direct lookup on TABLE_BITS bits, and a flat
+// binary tree holding the tails of codes longer than TABLE_BITS, public so
+// that callers can keep one without allocating
+typedef struct {
+  Entry entries[TABLE_SIZE];
+  uint16_t children[2 * ALPHABET][2];
+  uint32_t nodes;
+} DecodeTable;
+
+void table_init(DecodeTable *t, Code table[static ALPHABET]);
+
+DecodeTable *table_create(Code table[static ALPHABET]);
+
+void table_delete(DecodeTable **t);
+
+uint64_t table_decode(DecodeTable *t, BitReader *r, uint8_t *buf,
+                      uint64_t nbytes);
+
+bool table_decode_streams(DecodeTable *t, BitReader r[], uint32_t streams,
+                          uint8_t *buf, uint64_t nbytes);
+
+bool table_decode_context(DecodeTable tables[], uint8_t map[static ALPHABET],
+                          BitReader r[], uint32_t streams, uint8_t *buf,
+                          uint64_t nbytes);